@@ -1,26 +1,455 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
-int main(int argc, char *argv[]) {
-    FILE *file;
+#define BUF_SIZE (1 << 20)      // user-space copy buffer used when the kernel paths are unavailable
+#define BUF_ALIGN 4096          // page alignment keeps the buffer friendly to O_DIRECT and DMA
+#define KERNEL_CHUNK (1 << 30)  // largest single request handed to copy_file_range/splice/sendfile
+#define NUMBER_WIDTH 6          // same "%6d\t" layout as cat -n
+
+static char *buffer;
+static char *outbuf;            // staging area for -n output
+static size_t outlen;
+
+// Line scanning kernels, chosen once at startup by init_kernels()
+static size_t (*count_newlines)(const char *p, size_t n);
+static const char *(*find_newline)(const char *p, const char *end);
+
+// Writes the whole buffer to fd, retrying on short writes and signals
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Classic read/write loop through one large aligned buffer
+static int copy_buffered(int in, int out) {
+    ssize_t n;
+    while ((n = read(in, buffer, BUF_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (write_all(out, buffer, n) < 0) return -1;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+// Errors meaning "this syscall cannot handle these fds", as opposed to a real I/O failure
+static int unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP ||
+           err == EBADF || err == ESPIPE;
+}
+
+// Moves data between in and out without passing through user space.
+// Returns 1 if the input was drained, 0 if the caller should fall back to the
+// buffered loop and -1 on a real error. All three syscalls are used with NULL
+// offsets so the file positions advance and a fallback resumes where we stopped.
+static int copy_kernel(int in, int out) {
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) < 0 || fstat(out, &out_st) < 0) return 0;
+
+    int in_reg = S_ISREG(in_st.st_mode), out_reg = S_ISREG(out_st.st_mode);
+    int in_pipe = S_ISFIFO(in_st.st_mode), out_pipe = S_ISFIFO(out_st.st_mode);
+    ssize_t n;
+
+    // Regular file to regular file: let the filesystem copy (or reflink) the extents
+    if (in_reg && out_reg) {
+        while ((n = copy_file_range(in, NULL, out, NULL, KERNEL_CHUNK, 0)) > 0)
+            ;
+        if (n == 0) return 1;
+        if (!unsupported(errno)) return -1;
+    }
+
+    // One side is a pipe: move page references instead of bytes
+    if (in_pipe || out_pipe) {
+        while ((n = splice(in, NULL, out, NULL, KERNEL_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+            ;
+        if (n == 0) return 1;
+        if (!unsupported(errno)) return -1;
+    }
+
+    // Page-cache backed input to anything else (sockets, /dev/null, ttys on newer kernels)
+    if (in_reg) {
+        while ((n = sendfile(out, in, NULL, KERNEL_CHUNK)) > 0)
+            ;
+        if (n == 0) return 1;
+        if (!unsupported(errno)) return -1;
+    }
+
+    return 0;
+}
+#endif
+
+// Copies everything readable from in to out using the fastest path the fds allow
+static int copy_fd(int in, int out) {
+#ifdef __linux__
+    int r = copy_kernel(in, out);
+    if (r != 0) return r < 0 ? -1 : 0;
+#endif
+    return copy_buffered(in, out);
+}
+
+static size_t count_newlines_scalar(const char *p, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += p[i] == '\n';
+    }
+    return count;
+}
+
+static const char *find_newline_scalar(const char *p, const char *end) {
+    while (p < end && *p != '\n') p++;
+    return p;
+}
+
+#ifdef __x86_64__
+// Compare 16 bytes at a time and subtract the 0/-1 result into per-byte counters.
+// The counters are folded with psadbw every 255 blocks, before they can wrap.
+static size_t count_newlines_sse2(const char *p, size_t n) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t count = 0, i = 0;
+    while (i + 16 <= n) {
+        __m128i acc = _mm_setzero_si128();
+        for (int k = 0; k < 255 && i + 16 <= n; k++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, nl));
+        }
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+    }
+    return count + count_newlines_scalar(p + i, n - i);
+}
+
+static const char *find_newline_sse2(const char *p, const char *end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; p + 16 <= end; p += 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p), nl));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return find_newline_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static size_t count_newlines_avx2(const char *p, size_t n) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t count = 0, i = 0;
+    while (i + 32 <= n) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = 0; k < 255 && i + 32 <= n; k++, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, nl));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+                 _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+    }
+    return count + count_newlines_sse2(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static const char *find_newline_avx2(const char *p, const char *end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; p + 32 <= end; p += 32) {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) p), nl));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return find_newline_sse2(p, end);
+}
+#endif
+
+static void init_kernels(void) {
+    count_newlines = count_newlines_scalar;
+    find_newline = find_newline_scalar;
+#ifdef __x86_64__
+    // SSE2 is part of the x86-64 baseline, AVX2 needs a runtime check
+    count_newlines = count_newlines_sse2;
+    find_newline = find_newline_sse2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        count_newlines = count_newlines_avx2;
+        find_newline = find_newline_avx2;
+    }
+#endif
+}
+
+// Appends to the -n staging buffer, flushing to stdout when it fills up
+static int out_put(const char *p, size_t len) {
+    if (outlen + len > BUF_SIZE) {
+        if (write_all(STDOUT_FILENO, outbuf, outlen) < 0) return -1;
+        outlen = 0;
+        // Long line segments skip the staging copy
+        if (len > BUF_SIZE / 2) return write_all(STDOUT_FILENO, p, len);
+    }
+    memcpy(outbuf + outlen, p, len);
+    outlen += len;
+    return 0;
+}
+
+// Formats "%6llu\t" into dst without going through printf; returns the length
+static size_t format_number(char *dst, unsigned long long v) {
+    char digits[24];
+    size_t len = 0, pad;
+    do {
+        digits[len++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    pad = len < NUMBER_WIDTH ? NUMBER_WIDTH - len : 0;
+    memset(dst, ' ', pad);
+    for (size_t i = 0; i < len; i++) {
+        dst[pad + i] = digits[len - 1 - i];
+    }
+    dst[pad + len] = '\t';
+    return pad + len + 1;
+}
+
+// cat -n: numbering continues across files and across reads, so the
+// line counter and "at start of line" flag live outside the read loop
+static unsigned long long line_number = 1;
+static int at_line_start = 1;
+
+static int number_lines(int in) {
+    ssize_t n;
+    while ((n = read(in, buffer, BUF_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        const char *p = buffer, *end = buffer + n;
+        while (p < end) {
+            if (at_line_start) {
+                char num[32];
+                if (out_put(num, format_number(num, line_number++)) < 0) return -1;
+                at_line_start = 0;
+            }
+            const char *nl = find_newline(p, end);
+            if (nl < end) {
+                nl++;
+                at_line_start = 1;
+            }
+            if (out_put(p, nl - p) < 0) return -1;
+            p = nl;
+        }
+    }
+    return 0;
+}
+
+// cat -c: line and byte totals only, nothing is written
+static int count_lines(int in, unsigned long long *lines, unsigned long long *bytes) {
+    ssize_t n;
+    *lines = *bytes = 0;
+    while ((n = read(in, buffer, BUF_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        *lines += count_newlines(buffer, n);
+        *bytes += n;
+    }
+    return 0;
+}
+
+// The original implementation, one fgetc/putc per byte; kept as the benchmark baseline
+static int copy_bytewise(FILE *in, FILE *out) {
     int c;
+    while ((c = fgetc(in)) != EOF) {
+        putc(c, out);
+    }
+    return ferror(in) || ferror(out) ? -1 : 0;
+}
 
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, off_t bytes, double secs) {
+    printf("%-12s %10.3f s  %8.3f GB/s\n", name, secs, secs > 0 ? bytes / secs / 1e9 : 0.0);
+}
+
+// Copies the file to /dev/null with the byte loop, the buffered loop and the
+// kernel fast path, and prints the throughput of each
+static int benchmark(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        perror("Error opening file");
         return EXIT_FAILURE;
     }
+    printf("File: %s (%lld bytes)\n", path, (long long) st.st_size);
 
-    file = fopen(argv[1], "r");
-    if (file == NULL) {
+    // Byte loop through stdio
+    FILE *in = fopen(path, "r");
+    FILE *out = fopen("/dev/null", "w");
+    if (in == NULL || out == NULL) {
         perror("Error opening file");
         return EXIT_FAILURE;
     }
+    double t = now_seconds();
+    copy_bytewise(in, out);
+    fflush(out);
+    report("bytewise", st.st_size, now_seconds() - t);
+    fclose(in);
+    fclose(out);
 
-    while ((c = fgetc(file)) != EOF) {
-        putchar(c);
+    // Large buffer read/write, then the kernel path
+    for (int kernel = 0; kernel <= 1; kernel++) {
+        int in_fd = open(path, O_RDONLY);
+        int out_fd = open("/dev/null", O_WRONLY);
+        if (in_fd < 0 || out_fd < 0) {
+            perror("Error opening file");
+            return EXIT_FAILURE;
+        }
+        t = now_seconds();
+        int r = kernel ? copy_fd(in_fd, out_fd) : copy_buffered(in_fd, out_fd);
+        report(kernel ? "fast path" : "buffered", st.st_size, now_seconds() - t);
+        close(in_fd);
+        close(out_fd);
+        if (r < 0) {
+            perror("Error copying file");
+            return EXIT_FAILURE;
+        }
     }
 
-    fclose(file);
-
+    // Line counting, scalar loop against the dispatched SIMD kernel
+    for (int simd = 0; simd <= 1; simd++) {
+        size_t (*kernel)(const char *, size_t) = count_newlines;
+        unsigned long long lines, bytes;
+        if (!simd) count_newlines = count_newlines_scalar;
+        int in_fd = open(path, O_RDONLY);
+        if (in_fd < 0) {
+            perror("Error opening file");
+            return EXIT_FAILURE;
+        }
+        t = now_seconds();
+        count_lines(in_fd, &lines, &bytes);
+        report(simd ? "count simd" : "count scalar", st.st_size, now_seconds() - t);
+        close(in_fd);
+        count_newlines = kernel;
+    }
     return EXIT_SUCCESS;
 }
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n | -c] [file|-]...\n", prog);
+    fprintf(stderr, "  -n         number output lines\n");
+    fprintf(stderr, "  -c         print line and byte counts instead of the data\n");
+    fprintf(stderr, "       %s -B <file>   compare copy and line counting throughput\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int status = EXIT_SUCCESS;
+    int number = 0, count = 0;
+    int first, files;
+    unsigned long long total_lines = 0, total_bytes = 0;
+
+    init_kernels();
+
+    if (posix_memalign((void **) &buffer, BUF_ALIGN, BUF_SIZE) != 0 ||
+        posix_memalign((void **) &outbuf, BUF_ALIGN, BUF_SIZE) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "-B") == 0) {
+        status = benchmark(argv[2]);
+        free(buffer);
+        free(outbuf);
+        return status;
+    }
+
+    // Options come before the file operands; a lone "-" is stdin, "--" ends options
+    for (first = 1; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+        if (strcmp(argv[first], "--") == 0) {
+            first++;
+            break;
+        }
+        else if (strcmp(argv[first], "-n") == 0) {
+            number = 1;
+        }
+        else if (strcmp(argv[first], "-c") == 0) {
+            count = 1;
+        }
+        else {
+            usage(argv[0]);
+            free(buffer);
+            free(outbuf);
+            return EXIT_FAILURE;
+        }
+    }
+    files = argc - first;
+
+    // No operands means read standard input, as with "-"
+    for (int i = first; i < argc || i == first; i++) {
+        const char *name = i < argc ? argv[i] : "-";
+        int fd = STDIN_FILENO;
+        int r;
+
+        if (strcmp(name, "-") != 0) {
+            fd = open(name, O_RDONLY);
+            if (fd < 0) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], name, strerror(errno));
+                status = EXIT_FAILURE;
+                continue;
+            }
+        }
+
+        if (count) {
+            unsigned long long lines, bytes;
+            r = count_lines(fd, &lines, &bytes);
+            if (r == 0) {
+                total_lines += lines;
+                total_bytes += bytes;
+                if (files > 0) printf("%llu %llu %s\n", lines, bytes, name);
+                else printf("%llu %llu\n", lines, bytes);
+            }
+        }
+        else if (number) {
+            r = number_lines(fd);
+        }
+        else {
+            r = copy_fd(fd, STDOUT_FILENO);
+        }
+        if (r < 0) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], name, strerror(errno));
+            status = EXIT_FAILURE;
+        }
+
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+    }
+
+    if (count && files > 1) {
+        printf("%llu %llu total\n", total_lines, total_bytes);
+    }
+    if (outlen > 0 && write_all(STDOUT_FILENO, outbuf, outlen) < 0) {
+        perror("Error writing output");
+        status = EXIT_FAILURE;
+    }
+
+    free(buffer);
+    free(outbuf);
+
+    return status;
+}
@@ -1,27 +1,471 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
-int main(int argc, char *argv[]) {
+#define BLOCK_VALUES 65536  // values per block; block b always uses substream b
+#define MAX_DIGITS 21       // "-9223372036854775808" plus the separator
+#define BLOCK_BYTES (BLOCK_VALUES * MAX_DIGITS)
+#define MAX_THREADS 256
 
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <N>\n", argv[0]);
-        return EXIT_FAILURE;
+typedef unsigned __int128 u128;
+
+enum { XOSHIRO, PCG };
+enum { TEXT, BIN32, BIN64 };
+
+// State for both generators; only the half matching the selected kind is used
+typedef struct {
+    uint64_t s[4];  // xoshiro256**
+    u128 state;     // pcg64 (XSL-RR 128/64)
+    u128 inc;
+} Rng;
+
+// splitmix64, used to expand a single 64-bit seed into generator state
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t xoshiro_next(Rng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+#define PCG_MULT (((u128) 0x2360ed051fc65da4ULL << 64) | 0x4385df649fccf645ULL)
+
+static inline uint64_t pcg_next(Rng *r) {
+    r->state = r->state * PCG_MULT + r->inc;
+    uint64_t x = (uint64_t) (r->state >> 64) ^ (uint64_t) r->state;
+    int rot = r->state >> 122;
+    return (x >> rot) | (x << ((-rot) & 63));
+}
+
+static void rng_seed(Rng *r, uint64_t seed) {
+    uint64_t x = seed;
+    for (int i = 0; i < 4; i++) {
+        r->s[i] = splitmix64(&x);
     }
+    // one call per statement: the order of two calls within an expression is
+    // unspecified, and the stream for a seed must not depend on the compiler
+    uint64_t inc_hi = splitmix64(&x);
+    uint64_t inc_lo = splitmix64(&x);
+    uint64_t state_hi = splitmix64(&x);
+    uint64_t state_lo = splitmix64(&x);
+    r->inc = (((u128) inc_hi << 64) | inc_lo) | 1;
+    r->state = ((u128) state_hi << 64) | state_lo;
+    r->state = r->state * PCG_MULT + r->inc;
+}
+
+// Jump-ahead to the next substream. xoshiro256** uses the published jump
+// polynomial (2^128 steps); pcg64 applies a precomputed 2^64-step advance.
+static u128 pcg_jump_mult, pcg_jump_plus;
 
-    int N = atoi(argv[1]);
+static void pcg_init_jump(const Rng *r) {
+    u128 cur_mult = PCG_MULT, cur_plus = r->inc;
+    u128 acc_mult = 1, acc_plus = 0;
+    // Square-and-multiply over the LCG, delta = 2^64
+    for (int bit = 0; bit <= 64; bit++) {
+        if (bit == 64) {
+            acc_mult *= cur_mult;
+            acc_plus = acc_plus * cur_mult + cur_plus;
+        }
+        cur_plus = (cur_mult + 1) * cur_plus;
+        cur_mult *= cur_mult;
+    }
+    pcg_jump_mult = acc_mult;
+    pcg_jump_plus = acc_plus;
+}
+
+static void rng_jump(Rng *r, int kind) {
+    static const uint64_t jump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    if (kind == PCG) {
+        r->state = r->state * pcg_jump_mult + pcg_jump_plus;
+        return;
+    }
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b)) {
+                s0 ^= r->s[0];
+                s1 ^= r->s[1];
+                s2 ^= r->s[2];
+                s3 ^= r->s[3];
+            }
+            xoshiro_next(r);
+        }
+    }
+    r->s[0] = s0;
+    r->s[1] = s1;
+    r->s[2] = s2;
+    r->s[3] = s3;
+}
 
-    if (N <= 0) {
+static inline uint64_t rng_next(Rng *r, int kind) {
+    return kind == XOSHIRO ? xoshiro_next(r) : pcg_next(r);
+}
+
+// Lemire's multiply-shift: maps a 64-bit draw onto [0, range) by taking the high
+// half of x * range, rejecting the few low halves that would bias the result.
+// range == 0 stands for the full 2^64.
+static inline uint64_t rng_bounded(Rng *r, int kind, uint64_t range) {
+    if (range == 0) return rng_next(r, kind);
+    u128 m = (u128) rng_next(r, kind) * range;
+    if ((uint64_t) m < range) {
+        uint64_t threshold = -range % range;
+        while ((uint64_t) m < threshold) {
+            m = (u128) rng_next(r, kind) * range;
+        }
+    }
+    return m >> 64;
+}
+
+// Writes the whole buffer to fd, retrying on short writes and signals
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Two digits per division, looked up from "000102...99"
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Formats v followed by sep at p and returns the end of what was written
+static inline char *put_int(char *p, int64_t v, char sep) {
+    char tmp[MAX_DIGITS];
+    char *t = tmp + sizeof(tmp);
+    uint64_t u = v < 0 ? -(uint64_t) v : (uint64_t) v;
+
+    while (u >= 100) {
+        t -= 2;
+        memcpy(t, digit_pairs + (u % 100) * 2, 2);
+        u /= 100;
+    }
+    if (u >= 10) {
+        t -= 2;
+        memcpy(t, digit_pairs + u * 2, 2);
+    }
+    else {
+        *--t = '0' + u;
+    }
+    if (v < 0) *--t = '-';
+
+    size_t len = tmp + sizeof(tmp) - t;
+    memcpy(p, t, len);
+    p[len] = sep;
+    return p + len + 1;
+}
+
+// Byte stores so the binary format is little-endian on any host
+static inline char *put_le(char *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (char) (v >> (8 * i));
+    }
+    return p + bytes;
+}
+
+// Kept always_inline so each call in fill_block gets a loop specialised for
+// one generator and one output format
+static inline __attribute__((always_inline))
+size_t generate(Rng *r, int kind, int format, uint64_t count, int64_t min, uint64_t range, char *dst) {
+    char *p = dst;
+    for (uint64_t i = 0; i < count; i++) {
+        int64_t v = min + (int64_t) rng_bounded(r, kind, range);
+        if (format == TEXT) p = put_int(p, v, ' ');
+        else p = put_le(p, (uint64_t) v, format == BIN32 ? 4 : 8);
+    }
+    return p - dst;
+}
+
+static size_t fill_block(Rng *r, int kind, int format, uint64_t count, int64_t min, uint64_t range, char *dst) {
+    if (kind == XOSHIRO) {
+        if (format == TEXT) return generate(r, XOSHIRO, TEXT, count, min, range, dst);
+        if (format == BIN32) return generate(r, XOSHIRO, BIN32, count, min, range, dst);
+        return generate(r, XOSHIRO, BIN64, count, min, range, dst);
+    }
+    if (format == TEXT) return generate(r, PCG, TEXT, count, min, range, dst);
+    if (format == BIN32) return generate(r, PCG, BIN32, count, min, range, dst);
+    return generate(r, PCG, BIN64, count, min, range, dst);
+}
+
+// The output is cut into blocks of BLOCK_VALUES numbers and block b is drawn
+// from the generator after b jumps, so the bytes depend only on the seed and
+// never on how many threads produced them. Workers claim blocks in order
+// (taking the current substream and jumping the shared state once), fill a
+// ring of 2 * threads slots, and the main thread writes the slots in order.
+typedef struct {
+    char *data;
+    size_t len;
+    uint64_t block;     // block index currently held by this slot
+    int ready;
+} Slot;
+
+static struct {
+    int kind, format;
+    int64_t min;
+    uint64_t range;
+    uint64_t count;
+    uint64_t num_blocks;
+    uint64_t next_block;    // next block a worker will claim
+    uint64_t written;       // blocks already written by the main thread
+    Rng next_stream;        // substream for next_block
+    Slot *slots;
+    size_t num_slots;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    pthread_cond_t slot_ready;
+} job = {.lock = PTHREAD_MUTEX_INITIALIZER, .slot_free = PTHREAD_COND_INITIALIZER,
+         .slot_ready = PTHREAD_COND_INITIALIZER};
+
+static void *worker(void *arg) {
+    (void) arg;
+    while (1) {
+        pthread_mutex_lock(&job.lock);
+        uint64_t b = job.next_block;
+        if (b >= job.num_blocks) {
+            pthread_mutex_unlock(&job.lock);
+            return NULL;
+        }
+        Rng r = job.next_stream;
+        rng_jump(&job.next_stream, job.kind);
+        job.next_block++;
+        // The slot still holds block b - num_slots until the writer gets to it
+        while (b >= job.written + job.num_slots) {
+            pthread_cond_wait(&job.slot_free, &job.lock);
+        }
+        pthread_mutex_unlock(&job.lock);
+
+        Slot *slot = &job.slots[b % job.num_slots];
+        uint64_t n = job.count - b * BLOCK_VALUES < BLOCK_VALUES ? job.count - b * BLOCK_VALUES : BLOCK_VALUES;
+        slot->len = fill_block(&r, job.kind, job.format, n, job.min, job.range, slot->data);
+
+        pthread_mutex_lock(&job.lock);
+        slot->block = b;
+        slot->ready = 1;
+        pthread_cond_broadcast(&job.slot_ready);
+        pthread_mutex_unlock(&job.lock);
+    }
+}
+
+static int run(int threads) {
+    pthread_t tids[MAX_THREADS];
+    int status = 0;
+
+    job.num_blocks = (job.count + BLOCK_VALUES - 1) / BLOCK_VALUES;
+    job.num_slots = 2 * threads;
+    job.slots = calloc(job.num_slots, sizeof(Slot));
+    if (job.slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    for (size_t i = 0; i < job.num_slots; i++) {
+        job.slots[i].data = malloc(BLOCK_BYTES);
+        if (job.slots[i].data == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // With one thread the main thread fills the blocks itself
+    if (threads == 1) {
+        Slot *slot = &job.slots[0];
+        for (uint64_t b = 0; b < job.num_blocks; b++) {
+            uint64_t n = job.count - b * BLOCK_VALUES < BLOCK_VALUES ? job.count - b * BLOCK_VALUES : BLOCK_VALUES;
+            Rng r = job.next_stream;
+            rng_jump(&job.next_stream, job.kind);
+            slot->len = fill_block(&r, job.kind, job.format, n, job.min, job.range, slot->data);
+            if (write_all(STDOUT_FILENO, slot->data, slot->len) < 0) {
+                status = -1;
+                break;
+            }
+        }
+    }
+    else {
+        for (int t = 0; t < threads; t++) {
+            pthread_create(&tids[t], NULL, worker, NULL);
+        }
+        for (uint64_t b = 0; b < job.num_blocks; b++) {
+            Slot *slot = &job.slots[b % job.num_slots];
+            pthread_mutex_lock(&job.lock);
+            while (!slot->ready || slot->block != b) {
+                pthread_cond_wait(&job.slot_ready, &job.lock);
+            }
+            pthread_mutex_unlock(&job.lock);
+
+            if (status == 0 && write_all(STDOUT_FILENO, slot->data, slot->len) < 0) status = -1;
+
+            pthread_mutex_lock(&job.lock);
+            slot->ready = 0;
+            job.written = b + 1;
+            pthread_cond_broadcast(&job.slot_free);
+            pthread_mutex_unlock(&job.lock);
+        }
+        for (int t = 0; t < threads; t++) {
+            pthread_join(tids[t], NULL);
+        }
+    }
+
+    for (size_t i = 0; i < job.num_slots; i++) {
+        free(job.slots[i].data);
+    }
+    free(job.slots);
+    return status;
+}
+
+static int parse_int(const char *s, long long *v) {
+    char *end;
+    errno = 0;
+    *v = strtoll(s, &end, 10);
+    return errno == 0 && end != s && *end == '\0';
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-g xoshiro|pcg] [--seed S] [--min A] [--max B] [-j N] [-b 32|64] <N>\n", prog);
+    fprintf(stderr, "  -g       generator, xoshiro256** (default) or pcg64\n");
+    fprintf(stderr, "  --seed   64-bit seed; without it the clock and pid are used\n");
+    fprintf(stderr, "  --min/--max  inclusive range, default 0 to 2147483647\n");
+    fprintf(stderr, "  -j       generator threads; output is identical for any count\n");
+    fprintf(stderr, "  -b       raw little-endian int32 or int64 instead of text\n");
+}
+
+int main(int argc, char *argv[]) {
+    long long n = 0, min = 0, max = 2147483647, value;
+    int kind = XOSHIRO, format = TEXT, threads = 1, have_n = 0, have_seed = 0;
+    uint64_t seed = 0;
+    Rng rng;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "xoshiro") == 0) kind = XOSHIRO;
+            else if (strcmp(argv[i], "pcg") == 0) kind = PCG;
+            else {
+                fprintf(stderr, "Unknown generator: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            // Accept the full unsigned range as well as negative values
+            char *end;
+            errno = 0;
+            seed = argv[i + 1][0] == '-' ? (uint64_t) strtoll(argv[i + 1], &end, 10)
+                                         : strtoull(argv[i + 1], &end, 10);
+            if (errno != 0 || end == argv[i + 1] || *end != '\0') {
+                fprintf(stderr, "Invalid seed: %s\n", argv[i + 1]);
+                return EXIT_FAILURE;
+            }
+            have_seed = 1;
+            i++;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1 || threads > MAX_THREADS) {
+                fprintf(stderr, "Thread count must be between 1 and %d\n", MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "32") == 0) format = BIN32;
+            else if (strcmp(argv[i], "64") == 0) format = BIN64;
+            else {
+                fprintf(stderr, "Binary width must be 32 or 64\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--min") == 0 && i + 1 < argc) {
+            if (!parse_int(argv[++i], &min)) {
+                fprintf(stderr, "Invalid minimum: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc) {
+            if (!parse_int(argv[++i], &max)) {
+                fprintf(stderr, "Invalid maximum: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (!have_n && parse_int(argv[i], &value)) {
+            n = value;
+            have_n = 1;
+        }
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!have_n) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (n <= 0) {
         fprintf(stderr, "Please enter a positive integer\n");
         return EXIT_FAILURE;
     }
+    if (min > max) {
+        fprintf(stderr, "Minimum is larger than maximum\n");
+        return EXIT_FAILURE;
+    }
+    if (format == BIN32 && (min < INT32_MIN || max > INT32_MAX)) {
+        fprintf(stderr, "Range does not fit in int32, use -b 64\n");
+        return EXIT_FAILURE;
+    }
 
-    srand(time(NULL));
+    if (!have_seed) {
+        // Nanosecond clock plus pid, so runs in the same second still differ
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        seed = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        seed ^= (uint64_t) getpid() << 32;
+    }
+    rng_seed(&rng, seed);
+    pcg_init_jump(&rng);
 
-    for (int i = 0; i < N; i++) {
-        printf("%d ", rand());
+    job.kind = kind;
+    job.format = format;
+    job.min = min;
+    // max - min + 1 wraps to 0 for the full int64 range, which rng_bounded treats as 2^64
+    job.range = (uint64_t) max - (uint64_t) min + 1;
+    job.count = n;
+    job.next_stream = rng;
+    if (run(threads) < 0) {
+        perror("Error writing output");
+        return EXIT_FAILURE;
+    }
+
+    if (format == TEXT && write_all(STDOUT_FILENO, "\n", 1) < 0) {
+        perror("Error writing output");
+        return EXIT_FAILURE;
     }
-    printf("\n");
 
     return EXIT_SUCCESS;
 }
@@ -1,55 +1,989 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-#define INITIAL_SIZE 10
+#define INITIAL_SIZE 1024
+#define READ_SIZE (4 << 20)     // block size for non-mappable input (pipes, ttys)
+#define OUT_SIZE (1 << 20)      // formatted output is flushed in blocks of this size
+#define MAX_DIGITS 21           // "-9223372036854775808" plus the separator
+#define RADIX_BITS 11           // 3 passes for 32-bit keys, 6 for 64-bit keys
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define SIGN32 0x80000000U
+#define SIGN64 0x8000000000000000ULL
+#define MAX_THREADS 256
+#define MIN_RUN_BUFFER (1 << 20)    // smallest per-run read buffer during a merge
+#define MAX_FANIN 512               // runs merged at once; more take extra merge passes
+
+static int64_t *numbers;
+static size_t size;
+static size_t capacity;
+
+// External mode (-S): once run_limit values are buffered they are sorted and spilled
+static size_t run_limit;
+static void spill_run(void);
+
+// Streaming modes consume values as they are parsed instead of buffering them all
+enum { SORT_ALL, TOP_K, DISTINCT };
+static int mode = SORT_ALL;
+static int reverse_order;   // -r, for the modes that work on encoded keys
+
+static char out[OUT_SIZE];
+static size_t out_len;
+static int out_fd = STDOUT_FILENO;
 
 // Function to compare integers for qsort
 int compare(const void *a, const void *b) {
-    return (*(int *)a - *(int *)b);
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
 }
 
 // Function to compare integers in reverse order for qsort
 int reverse_compare(const void *a, const void *b) {
-    return (*(int *)b - *(int *)a);
+    return compare(b, a);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keys are stored so that plain unsigned order is the output order: sign-flipped,
+// and additionally inverted for -r
+static inline uint64_t to_key(int64_t v) {
+    uint64_t k = (uint64_t) v ^ SIGN64;
+    return reverse_order ? ~k : k;
+}
+
+static inline int64_t from_key(uint64_t k) {
+    return (int64_t) ((reverse_order ? ~k : k) ^ SIGN64);
+}
+
+// -k K: a max-heap of the K best keys seen so far. A new key only enters by
+// replacing the root, so memory stays O(K) however long the input is.
+static struct {
+    uint64_t *heap;
+    size_t k, n;
+} topk;
+
+static void topk_add(int64_t v) {
+    uint64_t key = to_key(v);
+    uint64_t *h = topk.heap;
+    size_t i;
+
+    if (topk.n < topk.k) {
+        // Sift up
+        for (i = topk.n++; i > 0 && h[(i - 1) / 2] < key; i = (i - 1) / 2) {
+            h[i] = h[(i - 1) / 2];
+        }
+        h[i] = key;
+        return;
+    }
+    if (key >= h[0]) return;
+
+    // Replace the root and sift down
+    i = 0;
+    while (1) {
+        size_t child = 2 * i + 1;
+        if (child >= topk.n) break;
+        if (child + 1 < topk.n && h[child + 1] > h[child]) child++;
+        if (h[child] <= key) break;
+        h[i] = h[child];
+        i = child;
+    }
+    h[i] = key;
+}
+
+// -u / -c: open addressing with linear probing, keyed by the encoded value.
+// A zero count marks an empty slot, and the table doubles at half load.
+typedef struct {
+    uint64_t key;
+    uint64_t count;
+} Entry;
+
+static struct {
+    Entry *slots;
+    size_t mask;
+    size_t used;
+} distinct;
+
+static inline size_t hash_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static void distinct_init(size_t slots) {
+    distinct.slots = calloc(slots, sizeof(Entry));
+    if (distinct.slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    distinct.mask = slots - 1;
+    distinct.used = 0;
+}
+
+static Entry *distinct_find(uint64_t key) {
+    size_t i = hash_key(key) & distinct.mask;
+    while (distinct.slots[i].count != 0 && distinct.slots[i].key != key) {
+        i = (i + 1) & distinct.mask;
+    }
+    return &distinct.slots[i];
+}
+
+static void distinct_add(int64_t v) {
+    uint64_t key = to_key(v);
+    Entry *e = distinct_find(key);
+    if (e->count++ != 0) return;
+    e->key = key;
+
+    if (++distinct.used * 2 > distinct.mask + 1) {
+        Entry *old = distinct.slots;
+        size_t old_slots = distinct.mask + 1, used = distinct.used;
+        distinct_init(old_slots * 2);
+        for (size_t i = 0; i < old_slots; i++) {
+            if (old[i].count) *distinct_find(old[i].key) = old[i];
+        }
+        distinct.used = used;
+        free(old);
+    }
+}
+
+static void append(int64_t v) {
+    if (mode != SORT_ALL) {
+        if (mode == TOP_K) topk_add(v);
+        else distinct_add(v);
+        return;
+    }
+    if (size == capacity) {
+        if (run_limit) {
+            spill_run();
+            numbers[size++] = v;
+            return;
+        }
+        capacity *= 2;
+        numbers = realloc(numbers, capacity * sizeof(int64_t));
+        if (numbers == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    numbers[size++] = v;
+}
+
+// SWAR digit test and conversion for 8 ASCII bytes loaded little-endian.
+// A byte is a digit when its high nibble is 3 and adding 6 does not carry into it.
+static inline int all_digits8(uint64_t v) {
+    return ((v & 0xf0f0f0f0f0f0f0f0ULL) |
+            (((v + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+// Combines digit pairs, then pairs of pairs, then the two halves: three multiplies for 8 digits
+static inline uint64_t parse8(uint64_t v) {
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+         (((v >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+    return v;
+}
+
+static inline uint64_t load8(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+// Parses every integer in [p, end) into numbers[]. Anything that is not a digit or
+// a sign in front of one separates numbers. Unless final is set, a number touching
+// end may continue in the next block, so parsing stops in front of it and the
+// returned pointer marks the unconsumed tail.
+static const char *parse_block(const char *p, const char *end, int final) {
+    while (p < end) {
+        // Skip separators
+        while (p < end && (unsigned char) (*p - '0') > 9 && *p != '-' && *p != '+') p++;
+        if (p == end) break;
+
+        const char *start = p;
+        int negative = 0;
+        if (*p == '-' || *p == '+') {
+            negative = *p == '-';
+            if (++p == end) return final ? end : start;
+            if ((unsigned char) (*p - '0') > 9) continue;
+        }
+
+        // Eight digits at a time while the whole word is digits, then one at a time
+        uint64_t v = 0;
+        const char *digits = p;
+        while (end - p >= 8 && all_digits8(load8(p))) {
+            v = v * 100000000 + parse8(load8(p));
+            p += 8;
+        }
+        unsigned d;
+        while (p < end && (d = (unsigned char) (*p - '0')) <= 9) {
+            v = v * 10 + d;
+            p++;
+        }
+        if (p == end && !final) return start;
+
+        // Up to 19 significant digits v is exact; int64 never needs more
+        size_t ndigits = p - digits;
+        while (ndigits > 1 && *digits == '0') {
+            digits++;
+            ndigits--;
+        }
+        if (ndigits > 19 || (negative ? v > (uint64_t) INT64_MAX + 1 : v > INT64_MAX)) {
+            fprintf(stderr, "Number out of range: %.*s\n", (int) (p - start), start);
+            exit(EXIT_FAILURE);
+        }
+        append(negative ? (int64_t) (0 - v) : (int64_t) v);
+    }
+    return end;
+}
+
+// Regular files are mapped and parsed in one pass; anything else is read in large
+// blocks, carrying a number cut in half by the block boundary over to the next read
+static int read_numbers(int fd) {
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            parse_block(map, map + st.st_size, 1);
+            munmap(map, st.st_size);
+            return 0;
+        }
+    }
+
+    char *buffer = malloc(READ_SIZE);
+    size_t carry = 0;
+    ssize_t n;
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    while ((n = read(fd, buffer + carry, READ_SIZE - carry)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(buffer);
+            return -1;
+        }
+        const char *end = buffer + carry + n;
+        const char *tail = parse_block(buffer, end, 0);
+        carry = end - tail;
+        if (carry == READ_SIZE) {
+            fprintf(stderr, "Number too long\n");
+            exit(EXIT_FAILURE);
+        }
+        memmove(buffer, tail, carry);
+    }
+    parse_block(buffer, buffer + carry, 1);
+    free(buffer);
+    return 0;
+}
+
+// LSD radix sort on unsigned keys. Signed values are mapped to unsigned ones by
+// flipping the sign bit, which keeps INT_MIN..INT_MAX in order with no comparisons.
+// All digit histograms come from a single read of the keys; a digit that is the
+// same for every key would leave the order unchanged, so its pass is skipped.
+// Returns whichever of keys/tmp holds the result.
+static uint32_t *radix_sort32(uint32_t *keys, uint32_t *tmp, size_t n) {
+    enum { PASSES = (32 + RADIX_BITS - 1) / RADIX_BITS };
+    static size_t count[PASSES][RADIX_SIZE];
+
+    memset(count, 0, sizeof(count));
+    for (size_t i = 0; i < n; i++) {
+        for (int p = 0; p < PASSES; p++) {
+            count[p][(keys[i] >> (p * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+
+    for (int p = 0; p < PASSES; p++) {
+        int shift = p * RADIX_BITS;
+        if (count[p][(keys[0] >> shift) & (RADIX_SIZE - 1)] == n) continue;
+
+        // Exclusive prefix sum turns the counts into bucket start offsets
+        size_t sum = 0;
+        for (int d = 0; d < RADIX_SIZE; d++) {
+            size_t c = count[p][d];
+            count[p][d] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            tmp[count[p][(keys[i] >> shift) & (RADIX_SIZE - 1)]++] = keys[i];
+        }
+        uint32_t *swap = keys;
+        keys = tmp;
+        tmp = swap;
+    }
+    return keys;
+}
+
+static uint64_t *radix_sort64(uint64_t *keys, uint64_t *tmp, size_t n) {
+    enum { PASSES = (64 + RADIX_BITS - 1) / RADIX_BITS };
+    static size_t count[PASSES][RADIX_SIZE];
+
+    memset(count, 0, sizeof(count));
+    for (size_t i = 0; i < n; i++) {
+        for (int p = 0; p < PASSES; p++) {
+            count[p][(keys[i] >> (p * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+
+    for (int p = 0; p < PASSES; p++) {
+        int shift = p * RADIX_BITS;
+        if (count[p][(keys[0] >> shift) & (RADIX_SIZE - 1)] == n) continue;
+
+        size_t sum = 0;
+        for (int d = 0; d < RADIX_SIZE; d++) {
+            size_t c = count[p][d];
+            count[p][d] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            tmp[count[p][(keys[i] >> shift) & (RADIX_SIZE - 1)]++] = keys[i];
+        }
+        uint64_t *swap = keys;
+        keys = tmp;
+        tmp = swap;
+    }
+    return keys;
+}
+
+// Parallel LSD radix sort (-j N). The keys are split into one contiguous range per
+// thread. Each pass, every thread counts digits in its own range; thread 0 then
+// turns the per-thread counts into scatter offsets ordered by (digit, thread), so
+// thread t's keys for digit d land right after thread t-1's and the pass stays
+// stable; finally every thread scatters its range. Output matches the serial sort.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int waiting;
+    int threads;
+    unsigned long generation;
+} Barrier;
+
+static void barrier_wait(Barrier *b) {
+    pthread_mutex_lock(&b->lock);
+    unsigned long generation = b->generation;
+    if (++b->waiting == b->threads) {
+        b->waiting = 0;
+        b->generation++;
+        pthread_cond_broadcast(&b->cond);
+    }
+    else {
+        while (generation == b->generation) {
+            pthread_cond_wait(&b->cond, &b->lock);
+        }
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static struct {
+    int threads;
+    int wide;                       // 64-bit keys
+    size_t n;
+    void *keys;
+    void *tmp;
+    void *result;
+    size_t (*count)[RADIX_SIZE];    // count[thread][digit], then scatter offsets
+    int skip;                       // every key shares this pass's digit
+    Barrier barrier;
+} par = {.barrier = {.lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER}};
+
+static void count_digits(size_t *count, const void *keys, size_t lo, size_t hi, int shift) {
+    memset(count, 0, RADIX_SIZE * sizeof(size_t));
+    if (par.wide) {
+        const uint64_t *k = keys;
+        for (size_t i = lo; i < hi; i++) count[(k[i] >> shift) & (RADIX_SIZE - 1)]++;
+    }
+    else {
+        const uint32_t *k = keys;
+        for (size_t i = lo; i < hi; i++) count[(k[i] >> shift) & (RADIX_SIZE - 1)]++;
+    }
+}
+
+static void scatter(size_t *offset, const void *keys, void *tmp, size_t lo, size_t hi, int shift) {
+    if (par.wide) {
+        const uint64_t *k = keys;
+        uint64_t *t = tmp;
+        for (size_t i = lo; i < hi; i++) t[offset[(k[i] >> shift) & (RADIX_SIZE - 1)]++] = k[i];
+    }
+    else {
+        const uint32_t *k = keys;
+        uint32_t *t = tmp;
+        for (size_t i = lo; i < hi; i++) t[offset[(k[i] >> shift) & (RADIX_SIZE - 1)]++] = k[i];
+    }
+}
+
+static void *radix_worker(void *arg) {
+    int id = (int) (intptr_t) arg;
+    int bits = par.wide ? 64 : 32;
+    size_t lo = par.n * id / par.threads, hi = par.n * (id + 1) / par.threads;
+    void *keys = par.keys, *tmp = par.tmp;
+
+    for (int shift = 0; shift < bits; shift += RADIX_BITS) {
+        count_digits(par.count[id], keys, lo, hi, shift);
+        barrier_wait(&par.barrier);
+
+        if (id == 0) {
+            size_t sum = 0;
+            par.skip = 0;
+            for (int d = 0; d < RADIX_SIZE; d++) {
+                size_t total = 0;
+                for (int t = 0; t < par.threads; t++) {
+                    size_t c = par.count[t][d];
+                    par.count[t][d] = sum;
+                    sum += c;
+                    total += c;
+                }
+                if (total == par.n) par.skip = 1;
+            }
+        }
+        barrier_wait(&par.barrier);
+
+        if (!par.skip) {
+            scatter(par.count[id], keys, tmp, lo, hi, shift);
+            void *swap = keys;
+            keys = tmp;
+            tmp = swap;
+        }
+        // Nobody may recount (overwriting offsets or reading keys) until all scatters finish
+        barrier_wait(&par.barrier);
+    }
+
+    if (id == 0) par.result = keys;
+    return NULL;
+}
+
+// Sorts flipped keys with the given thread count; returns whichever of keys/tmp holds the result
+static void *sort_keys(void *keys, void *tmp, size_t n, int wide, int threads) {
+    pthread_t tids[MAX_THREADS];
+
+    if (threads == 1) {
+        return wide ? (void *) radix_sort64(keys, tmp, n) : (void *) radix_sort32(keys, tmp, n);
+    }
+
+    par.threads = threads;
+    par.wide = wide;
+    par.n = n;
+    par.keys = keys;
+    par.tmp = tmp;
+    par.barrier.threads = threads;
+    par.count = malloc(threads * sizeof(*par.count));
+    if (par.count == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&tids[t], NULL, radix_worker, (void *) (intptr_t) t);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(par.count);
+    return par.result;
+}
+
+// -T: sorts a copy of the keys at 1, 2, 4, ... up to max_threads threads and prints
+// the time, speedup over one thread and per-thread efficiency of each run
+static void report_scaling(const void *keys, size_t n, int wide, int max_threads) {
+    size_t bytes = n * (wide ? sizeof(uint64_t) : sizeof(uint32_t));
+    void *work = malloc(bytes), *tmp = malloc(bytes);
+    double base = 0;
+
+    if (work == NULL || tmp == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "threads      time   speedup  efficiency\n");
+    for (int t = 1; ; t = t * 2 > max_threads ? max_threads : t * 2) {
+        memcpy(work, keys, bytes);
+        double start = now_seconds();
+        sort_keys(work, tmp, n, wide, t);
+        double secs = now_seconds() - start;
+        if (t == 1) base = secs;
+        fprintf(stderr, "%7d %8.3f s %8.2fx %10.0f%%\n", t, secs, base / secs, 100 * base / secs / t);
+        if (t == max_threads) break;
+    }
+    free(work);
+    free(tmp);
+}
+
+// -r is applied to the sorted keys as one last pass rather than through a second comparator
+static void reverse_keys32(uint32_t *keys, size_t n) {
+    for (size_t i = 0, j = n - 1; i < j; i++, j--) {
+        uint32_t swap = keys[i];
+        keys[i] = keys[j];
+        keys[j] = swap;
+    }
+}
+
+static void reverse_keys64(uint64_t *keys, size_t n) {
+    for (size_t i = 0, j = n - 1; i < j; i++, j--) {
+        uint64_t swap = keys[i];
+        keys[i] = keys[j];
+        keys[j] = swap;
+    }
+}
+
+// Writes the whole buffer to fd, retrying on short writes and signals
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void flush_out(void) {
+    if (write_all(out_fd, out, out_len) < 0) {
+        perror("Error writing output");
+        exit(EXIT_FAILURE);
+    }
+    out_len = 0;
+}
+
+// Two digits per division, looked up from "000102...99"
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Formats v and a separator straight into the output buffer
+static inline void put_int(int64_t v, char sep) {
+    char tmp[MAX_DIGITS];
+    char *t = tmp + sizeof(tmp);
+    uint64_t u = v < 0 ? -(uint64_t) v : (uint64_t) v;
+
+    if (out_len + MAX_DIGITS + 1 > OUT_SIZE) flush_out();
+
+    while (u >= 100) {
+        t -= 2;
+        memcpy(t, digit_pairs + (u % 100) * 2, 2);
+        u /= 100;
+    }
+    if (u >= 10) {
+        t -= 2;
+        memcpy(t, digit_pairs + u * 2, 2);
+    }
+    else {
+        *--t = '0' + u;
+    }
+    if (v < 0) *--t = '-';
+
+    size_t len = tmp + sizeof(tmp) - t;
+    memcpy(out + out_len, t, len);
+    out_len += len;
+    out[out_len++] = sep;
+}
+
+// External merge sort (-S budget). The parser fills a fixed buffer of run_limit
+// values; each full buffer is radix sorted and written as one run of raw 64-bit
+// keys to an unlinked temporary file. The runs are then merged through a loser
+// tree, each run read back sequentially through its own large buffer. With more
+// than MAX_FANIN runs, or too little memory for a buffer per run, groups of runs
+// are first merged into longer runs.
+typedef struct {
+    int fd;
+    uint64_t count;     // keys in the run
+    uint64_t remaining; // keys not yet read back
+    uint64_t *buf;
+    size_t len, pos;
+} Run;
+
+static struct {
+    size_t budget;
+    int threads;
+    uint64_t *tmp;      // radix scratch for a run
+    Run *runs;
+    size_t num_runs, cap_runs;
+    size_t spilled;     // runs written by the parser, for -t
+    int passes;         // merge passes including the final one, for -t
+} ext;
+
+static int temp_file(void) {
+    const char *dir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/sortXXXXXX", dir && *dir ? dir : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("Error creating temporary file");
+        exit(EXIT_FAILURE);
+    }
+    // Unlinked right away so the runs disappear however we exit
+    unlink(path);
+    return fd;
+}
+
+static void add_run(int fd, uint64_t count) {
+    if (ext.num_runs == ext.cap_runs) {
+        ext.cap_runs = ext.cap_runs ? ext.cap_runs * 2 : 16;
+        ext.runs = realloc(ext.runs, ext.cap_runs * sizeof(Run));
+        if (ext.runs == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ext.runs[ext.num_runs++] = (Run) {.fd = fd, .count = count};
+}
+
+// Sorts the buffered values in place as keys; returns where the sorted keys ended up
+static uint64_t *sort_buffer(void) {
+    uint64_t *keys = (uint64_t *) numbers;
+    for (size_t i = 0; i < size; i++) {
+        keys[i] = to_key(numbers[i]);
+    }
+    if (size < 2) return keys;
+    return sort_keys(keys, ext.tmp, size, 1, ext.threads);
+}
+
+static void spill_run(void) {
+    uint64_t *keys = sort_buffer();
+    int fd = temp_file();
+    if (write_all(fd, (const char *) keys, size * sizeof(uint64_t)) < 0) {
+        perror("Error writing temporary file");
+        exit(EXIT_FAILURE);
+    }
+    add_run(fd, size);
+    ext.spilled++;
+    size = 0;
+}
+
+// Refills a run's buffer; returns 0 once the run is exhausted
+static int run_fill(Run *r) {
+    size_t want = r->remaining < r->len ? r->remaining : r->len;
+    size_t bytes = want * sizeof(uint64_t), got = 0;
+    while (got < bytes) {
+        ssize_t n = read(r->fd, (char *) r->buf + got, bytes - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            perror("Error reading temporary file");
+            exit(EXIT_FAILURE);
+        }
+        got += n;
+    }
+    r->remaining -= want;
+    r->len = want;
+    r->pos = 0;
+    return want > 0;
+}
+
+// Loser tree over k runs: node 0 holds the overall winner, nodes 1..k-1 the loser
+// of the match played there, and run i sits at leaf k + i. An exhausted run loses
+// against everything, so no sentinel key is needed.
+static Run *lt_runs;
+static int *lt_done;
+static uint64_t *lt_key;
+
+static inline int beats(int a, int b) {
+    if (lt_done[a]) return 0;
+    if (lt_done[b]) return 1;
+    return lt_key[a] < lt_key[b] || (lt_key[a] == lt_key[b] && a < b);
+}
+
+static int lt_build(int *tree, int node, int k) {
+    if (node >= k) return node - k;
+    int l = lt_build(tree, 2 * node, k), r = lt_build(tree, 2 * node + 1, k);
+    if (beats(l, r)) {
+        tree[node] = r;
+        return l;
+    }
+    tree[node] = l;
+    return r;
+}
+
+static inline void lt_advance(Run *r, int i) {
+    if (r->pos == r->len && !run_fill(r)) {
+        lt_done[i] = 1;
+        return;
+    }
+    lt_key[i] = r->buf[r->pos++];
+}
+
+// Merges runs[0..k) into out_run (binary keys) or, when out_run is NULL, into the
+// formatted output. buffer_bytes is the read buffer given to each run.
+static void merge(Run *runs, int k, Run *out_run, size_t buffer_bytes) {
+    int *tree = malloc(k * sizeof(int));
+    uint64_t *out_buf = NULL;
+    size_t out_cap = buffer_bytes / sizeof(uint64_t), out_n = 0;
+
+    lt_runs = runs;
+    lt_done = calloc(k, sizeof(int));
+    lt_key = malloc(k * sizeof(uint64_t));
+    if (out_run) out_buf = malloc(buffer_bytes);
+    if (tree == NULL || lt_done == NULL || lt_key == NULL || (out_run && out_buf == NULL)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < k; i++) {
+        Run *r = &runs[i];
+        r->buf = malloc(buffer_bytes);
+        if (r->buf == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        r->len = buffer_bytes / sizeof(uint64_t);
+        r->pos = r->len;
+        r->remaining = r->count;
+        lseek(r->fd, 0, SEEK_SET);
+        lt_advance(r, i);
+    }
+
+    tree[0] = lt_build(tree, 1, k);
+    while (!lt_done[tree[0]]) {
+        int w = tree[0];
+        if (out_run) {
+            out_buf[out_n++] = lt_key[w];
+            if (out_n == out_cap) {
+                if (write_all(out_run->fd, (const char *) out_buf, out_n * sizeof(uint64_t)) < 0) {
+                    perror("Error writing temporary file");
+                    exit(EXIT_FAILURE);
+                }
+                out_n = 0;
+            }
+        }
+        else {
+            put_int(from_key(lt_key[w]), '\n');
+        }
+
+        // Replay only the path from the winner's leaf to the root
+        lt_advance(&runs[w], w);
+        for (int node = (w + k) / 2; node > 0; node /= 2) {
+            if (beats(tree[node], w)) {
+                int swap = tree[node];
+                tree[node] = w;
+                w = swap;
+            }
+        }
+        tree[0] = w;
+    }
+
+    if (out_run && write_all(out_run->fd, (const char *) out_buf, out_n * sizeof(uint64_t)) < 0) {
+        perror("Error writing temporary file");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < k; i++) {
+        free(runs[i].buf);
+        close(runs[i].fd);
+    }
+    free(out_buf);
+    free(tree);
+    free(lt_done);
+    free(lt_key);
+}
+
+// Chooses the widest merge the budget allows: every input run, plus the output
+// run for intermediate passes, needs a buffer of at least MIN_RUN_BUFFER
+static int merge_fanin(void) {
+    size_t fanin = ext.budget / MIN_RUN_BUFFER - 1;
+    if (fanin > MAX_FANIN) fanin = MAX_FANIN;
+    if (fanin < 2) fanin = 2;
+    return fanin;
+}
+
+static int external_sort(int input) {
+    size_t values = ext.budget / (2 * sizeof(uint64_t));
+
+    // The run buffer and its radix scratch space share the budget
+    run_limit = capacity = values;
+    free(numbers);
+    numbers = malloc(values * sizeof(int64_t));
+    ext.tmp = malloc(values * sizeof(uint64_t));
+    if (numbers == NULL || ext.tmp == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (read_numbers(input) < 0) return -1;
+
+    // Everything fit in one buffer: no temporary files at all
+    if (ext.num_runs == 0) {
+        uint64_t *keys = sort_buffer();
+        for (size_t i = 0; i < size; i++) {
+            put_int(from_key(keys[i]), '\n');
+        }
+        free(ext.tmp);
+        return 0;
+    }
+    if (size > 0) spill_run();
+    free(ext.tmp);
+    free(numbers);
+    numbers = NULL;
+
+    int fanin = merge_fanin();
+    while (ext.num_runs > (size_t) fanin) {
+        // One pass merging consecutive groups of fanin runs into new runs
+        size_t next = 0;
+        for (size_t first = 0; first < ext.num_runs; first += fanin) {
+            int k = ext.num_runs - first < (size_t) fanin ? (int) (ext.num_runs - first) : fanin;
+            Run merged = {.fd = temp_file(), .count = 0};
+            for (int i = 0; i < k; i++) merged.count += ext.runs[first + i].count;
+            merge(&ext.runs[first], k, &merged, ext.budget / (k + 1));
+            ext.runs[next++] = merged;
+        }
+        ext.num_runs = next;
+        ext.passes++;
+    }
+    ext.passes++;
+    merge(ext.runs, ext.num_runs, NULL, ext.budget / ext.num_runs);
+    free(ext.runs);
+    return 0;
+}
+
+// Prints the top-K heap, best first
+static void topk_output(int threads) {
+    uint64_t *tmp = malloc((topk.n ? topk.n : 1) * sizeof(uint64_t));
+    uint64_t *keys = topk.heap;
+    if (tmp == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (topk.n > 1) keys = sort_keys(keys, tmp, topk.n, 1, threads);
+    for (size_t i = 0; i < topk.n; i++) {
+        put_int(from_key(keys[i]), '\n');
+    }
+    free(tmp);
+}
+
+// Sorts only the distinct keys; with counts, each line is "count value" as in uniq -c
+static void distinct_output(int counts, int threads) {
+    uint64_t *keys = malloc((distinct.used ? distinct.used : 1) * sizeof(uint64_t));
+    uint64_t *tmp = malloc((distinct.used ? distinct.used : 1) * sizeof(uint64_t));
+    uint64_t *sorted = keys;
+    size_t n = 0;
+    if (keys == NULL || tmp == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i <= distinct.mask; i++) {
+        if (distinct.slots[i].count) keys[n++] = distinct.slots[i].key;
+    }
+    if (n > 1) sorted = sort_keys(keys, tmp, n, 1, threads);
+    for (size_t i = 0; i < n; i++) {
+        if (counts) put_int(distinct_find(sorted[i])->count, ' ');
+        put_int(from_key(sorted[i]), '\n');
+    }
+    free(keys);
+    free(tmp);
+}
+
+// Parses "512K", "64M", "2G" or a plain byte count
+static size_t parse_size(const char *s) {
+    char *end;
+    errno = 0;
+    int shift = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno != 0 || *s < '0' || *s > '9') return 0;  // no sign, no blanks
+    switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    case 't': case 'T': shift = 40; end++; break;
+    }
+    // a size that does not fit is as invalid as one that does not parse
+    if (*end != '\0' || v > (SIZE_MAX >> shift)) return 0;
+    return (size_t) v << shift;
 }
 
 int main(int argc, char *argv[]) {
-    int capacity = INITIAL_SIZE;
-    int size = 0;
-    int *numbers = malloc(capacity * sizeof(int));
+    capacity = INITIAL_SIZE;
+    numbers = malloc(capacity * sizeof(int64_t));
     if (numbers == NULL) {
         fprintf(stderr, "Memory allocation failed\n");
         return EXIT_FAILURE;
     }
 
-    FILE *input = stdin;
-    FILE *output = stdout;
+    int input = STDIN_FILENO;
     int reverse = 0;
+    int timing = 0;
+    int use_qsort = 0;
+    int threads = 1;
+    int scaling = 0;
+    size_t budget = 0;
+    size_t top = 0;
+    int unique = 0, counts = 0;
 
     // Parsing command-line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-r") == 0) {
             reverse = 1;
-        } 
+        }
+        else if (strcmp(argv[i], "-t") == 0) {
+            timing = 1;
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            use_qsort = 1;
+        }
+        else if (strcmp(argv[i], "-T") == 0) {
+            scaling = 1;
+        }
+        else if (strcmp(argv[i], "-u") == 0) {
+            unique = 1;
+        }
+        else if (strcmp(argv[i], "-c") == 0) {
+            counts = 1;
+        }
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            char *end;
+            top = strtoull(argv[++i], &end, 10);
+            if (top == 0 || *end != '\0') {
+                fprintf(stderr, "-k needs a positive count\n");
+                free(numbers);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            budget = parse_size(argv[++i]);
+            if (budget < 4 * MIN_RUN_BUFFER) {
+                fprintf(stderr, "Memory budget must be a size such as 64M, of at least %dM\n", 4 * MIN_RUN_BUFFER >> 20);
+                free(numbers);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1 || threads > MAX_THREADS) {
+                fprintf(stderr, "Thread count must be between 1 and %d\n", MAX_THREADS);
+                free(numbers);
+                return EXIT_FAILURE;
+            }
+        }
         else if (strcmp(argv[i], "-o") == 0) {
             if (i + 1 < argc) {
-                output = fopen(argv[++i], "w");
-                if (output == NULL) {
+                out_fd = open(argv[++i], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+                if (out_fd < 0) {
                     perror("Error opening output file");
                     free(numbers);
                     return EXIT_FAILURE;
                 }
-            } 
+            }
             else {
                 fprintf(stderr, "No output file specified\n");
                 free(numbers);
                 return EXIT_FAILURE;
             }
-        } 
+        }
         else {
-            input = fopen(argv[i], "r");
-            if (input == NULL) {
+            input = open(argv[i], O_RDONLY);
+            if (input < 0) {
                 perror("Error opening input file");
                 free(numbers);
                 return EXIT_FAILURE;
@@ -57,34 +991,151 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // Reading
-    while (scanf("%d", &numbers[size]) == 1) {
-        size++;
-        if (size == capacity) {
-            capacity *= 2;
-            numbers = realloc(numbers, capacity * sizeof(int));
-            if (numbers == NULL) {
+    reverse_order = reverse;
+    if ((top > 0) + (unique || counts) + (budget > 0) > 1) {
+        fprintf(stderr, "-k, -u/-c and -S cannot be combined\n");
+        free(numbers);
+        return EXIT_FAILURE;
+    }
+
+    // Top-K and distinct modes never hold more than K values or the distinct set
+    if (top > 0 || unique || counts) {
+        double start = now_seconds();
+        free(numbers);
+        numbers = NULL;
+        if (top > 0) {
+            mode = TOP_K;
+            topk.k = top;
+            topk.heap = malloc(top * sizeof(uint64_t));
+            if (topk.heap == NULL) {
                 fprintf(stderr, "Memory allocation failed\n");
                 return EXIT_FAILURE;
             }
         }
+        else {
+            mode = DISTINCT;
+            distinct_init(1024);
+        }
+        if (read_numbers(input) < 0) {
+            perror("Error reading input");
+            return EXIT_FAILURE;
+        }
+        if (mode == TOP_K) topk_output(threads);
+        else distinct_output(counts, threads);
+        flush_out();
+        if (timing) {
+            fprintf(stderr, "%zu values kept, %.3f s\n", mode == TOP_K ? topk.n : distinct.used,
+                    now_seconds() - start);
+        }
+        free(topk.heap);
+        free(distinct.slots);
+        if (input != STDIN_FILENO) close(input);
+        if (out_fd != STDOUT_FILENO) close(out_fd);
+        return EXIT_SUCCESS;
+    }
+
+    // External mode streams through a fixed budget and does its own reading and writing
+    if (budget > 0) {
+        double start = now_seconds();
+        ext.budget = budget;
+        ext.threads = threads;
+        if (external_sort(input) < 0) {
+            perror("Error reading input");
+            return EXIT_FAILURE;
+        }
+        flush_out();
+        if (timing) {
+            fprintf(stderr, "%zu runs, %d merge passes, %.3f s\n", ext.spilled, ext.passes, now_seconds() - start);
+        }
+        free(numbers);
+        if (input != STDIN_FILENO) close(input);
+        if (out_fd != STDOUT_FILENO) close(out_fd);
+        return EXIT_SUCCESS;
+    }
+
+    // Reading
+    double t0 = now_seconds();
+    if (read_numbers(input) < 0) {
+        perror("Error reading input");
+        free(numbers);
+        return EXIT_FAILURE;
     }
 
     // Sorting
-    qsort(numbers, size, sizeof(int), reverse ? reverse_compare : compare);
+    double t1 = now_seconds(), t2;
+    if (use_qsort || size < 2) {
+        qsort(numbers, size, sizeof(int64_t), reverse ? reverse_compare : compare);
 
-    for (int i = 0; i < size; i++) {
-        fprintf(output, "%d\n", numbers[i]);
+        // Writing
+        t2 = now_seconds();
+        for (size_t i = 0; i < size; i++) {
+            put_int(numbers[i], '\n');
+        }
+    }
+    else {
+        int64_t lo = numbers[0], hi = numbers[0];
+        for (size_t i = 1; i < size; i++) {
+            if (numbers[i] < lo) lo = numbers[i];
+            if (numbers[i] > hi) hi = numbers[i];
+        }
+        void *tmp = malloc(size * sizeof(int64_t));
+        if (tmp == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            free(numbers);
+            return EXIT_FAILURE;
+        }
+
+        if (lo >= INT32_MIN && hi <= INT32_MAX) {
+            // Everything fits in 32 bits: narrow the keys in place (each write lands
+            // at or below the slot being read) and sort half the bytes
+            uint32_t *keys = (uint32_t *) numbers;
+            for (size_t i = 0; i < size; i++) {
+                keys[i] = (uint32_t) (int32_t) numbers[i] ^ SIGN32;
+            }
+            if (scaling) report_scaling(keys, size, 0, threads);
+            keys = sort_keys(keys, tmp, size, 0, threads);
+            if (reverse) reverse_keys32(keys, size);
+
+            // Writing
+            t2 = now_seconds();
+            for (size_t i = 0; i < size; i++) {
+                put_int((int32_t) (keys[i] ^ SIGN32), '\n');
+            }
+        }
+        else {
+            uint64_t *keys = (uint64_t *) numbers;
+            for (size_t i = 0; i < size; i++) {
+                keys[i] ^= SIGN64;
+            }
+            if (scaling) report_scaling(keys, size, 1, threads);
+            keys = sort_keys(keys, tmp, size, 1, threads);
+            if (reverse) reverse_keys64(keys, size);
+
+            // Writing
+            t2 = now_seconds();
+            for (size_t i = 0; i < size; i++) {
+                put_int((int64_t) (keys[i] ^ SIGN64), '\n');
+            }
+        }
+        free(tmp);
+    }
+    flush_out();
+    double t3 = now_seconds();
+
+    // -t reports where the time went, on stderr so it never mixes with the output
+    if (timing) {
+        fprintf(stderr, "%zu values: parse %.3f s, sort %.3f s, write %.3f s\n",
+                size, t1 - t0, t2 - t1, t3 - t2);
     }
 
     // Clear the allocation
     free(numbers);
-    if (input != stdin) {
-        fclose(input);
+    if (input != STDIN_FILENO) {
+        close(input);
     }
-    if (output != stdout) {
-        fclose(output);
+    if (out_fd != STDOUT_FILENO) {
+        close(out_fd);
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
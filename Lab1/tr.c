@@ -1,25 +1,513 @@
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#define BUF_SIZE (1 << 20)  // input is translated in place one block at a time
+#define SET_MAX 4096        // expanded length limit for SET1/SET2 (ranges may repeat characters)
+#define MAX_RULES 8         // above this many ranges the lookup table beats compare/blend
+#define CHUNK_SIZE (4 << 20) // unit of work for the -j worker threads
+#define MAX_THREADS 256
+
+// A run of consecutive source bytes that all move by the same amount,
+// e.g. a-z -> A-Z is the single rule {'a', 'z', 'A' - 'a'}
+typedef struct {
+    unsigned char lo;
+    unsigned char hi;
+    unsigned char delta;
+} Rule;
+
+static unsigned char table[256];
+static Rule rules[MAX_RULES];
+static int num_rules;   // -1 when the mapping needs the full table
+static unsigned char delete_set[256];   // -d: bytes removed before translation
+static unsigned char squeeze_set[256];  // -s: bytes whose repeats collapse to one
+static int filtering;                   // -d or -s given, output may be shorter than input
+
+// Character classes accepted inside [:name:]
+static const struct {
+    const char *name;
+    int (*test)(int);
+} classes[] = {
+    {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank}, {"cntrl", iscntrl},
+    {"digit", isdigit}, {"graph", isgraph}, {"lower", islower}, {"print", isprint},
+    {"punct", ispunct}, {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+};
+
+// Reads one possibly escaped character from *s and advances past it
+static unsigned char parse_char(const char **s) {
+    const char *p = *s;
+    unsigned char c = *p++;
+
+    if (c == '\\' && *p != '\0') {
+        c = *p++;
+        switch (c) {
+        case 'a': c = '\a'; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'v': c = '\v'; break;
+        default:
+            // Up to three octal digits, \0 through \377
+            if (c >= '0' && c <= '7') {
+                int v = c - '0';
+                for (int i = 0; i < 2 && *p >= '0' && *p <= '7'; i++) {
+                    v = v * 8 + (*p++ - '0');
+                }
+                if (v > 255) {
+                    fprintf(stderr, "tr: octal escape out of range\n");
+                    exit(EXIT_FAILURE);
+                }
+                c = v;
+            }
+            // Anything else (\\, \-, \[) is the character itself
+            break;
+        }
+    }
+    *s = p;
+    return c;
+}
+
+// Expands a SET operand (ranges, [:class:] and escapes) into a flat list of
+// characters and returns its length
+static int expand_set(const char *spec, unsigned char *out) {
+    int len = 0;
+
+    while (*spec) {
+        if (spec[0] == '[' && spec[1] == ':') {
+            const char *close = strstr(spec + 2, ":]");
+            size_t name_len = close ? (size_t) (close - spec - 2) : 0;
+            size_t k;
+            for (k = 0; close && k < sizeof(classes) / sizeof(classes[0]); k++) {
+                if (strlen(classes[k].name) == name_len && strncmp(spec + 2, classes[k].name, name_len) == 0)
+                    break;
+            }
+            if (close && k < sizeof(classes) / sizeof(classes[0])) {
+                for (int c = 0; c < 256; c++) {
+                    if (classes[k].test(c)) {
+                        if (len == SET_MAX) goto too_long;
+                        out[len++] = c;
+                    }
+                }
+                spec = close + 2;
+                continue;
+            }
+            // Not a known class: fall through and treat '[' literally
+        }
+
+        unsigned char lo = parse_char(&spec);
+        if (spec[0] == '-' && spec[1] != '\0') {
+            spec++;
+            unsigned char hi = parse_char(&spec);
+            if (hi < lo) {
+                fprintf(stderr, "tr: range-endpoints of '%c-%c' are in reverse collating sequence order\n", lo, hi);
+                exit(EXIT_FAILURE);
+            }
+            for (int c = lo; c <= hi; c++) {
+                if (len == SET_MAX) goto too_long;
+                out[len++] = c;
+            }
+        }
+        else {
+            if (len == SET_MAX) goto too_long;
+            out[len++] = lo;
+        }
+    }
+    return len;
+
+too_long:
+    fprintf(stderr, "tr: set expands to more than %d characters\n", SET_MAX);
+    exit(EXIT_FAILURE);
+}
+
+// Fills the lookup table from the two sets; a short SET2 is padded with its last character
+static void build_table(const unsigned char *set1, int len1, const unsigned char *set2, int len2) {
+    for (int c = 0; c < 256; c++) {
+        table[c] = c;
+    }
+    for (int i = 0; i < len1; i++) {
+        table[set1[i]] = set2[i < len2 ? i : len2 - 1];
+    }
+}
+
+// Collapses the table into runs of equal delta. If there are few enough of them,
+// the SIMD kernel can do the translation with range compares instead of lookups.
+static void build_rules(void) {
+    num_rules = 0;
+    for (int c = 0; c < 256; c++) {
+        if (table[c] == c) continue;
+        unsigned char delta = table[c] - c;
+        if (num_rules > 0 && rules[num_rules - 1].hi == c - 1 && rules[num_rules - 1].delta == delta) {
+            rules[num_rules - 1].hi = c;
+            continue;
+        }
+        if (num_rules == MAX_RULES) {
+            num_rules = -1;
+            return;
+        }
+        rules[num_rules++] = (Rule) {c, c, delta};
+    }
+}
+
+static void translate_table(const unsigned char *src, unsigned char *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = table[src[i]];
+    }
+}
+
+#ifdef __x86_64__
+// x is in [lo, hi] exactly when (unsigned char) (x - lo) <= hi - lo, which SSE2
+// can test with a saturating min: min(x - lo, hi - lo) == x - lo
+static size_t translate_sse2(const unsigned char *src, unsigned char *dst, size_t n) {
+    __m128i lo[MAX_RULES], width[MAX_RULES], delta[MAX_RULES];
+    for (int r = 0; r < num_rules; r++) {
+        lo[r] = _mm_set1_epi8(rules[r].lo);
+        width[r] = _mm_set1_epi8(rules[r].hi - rules[r].lo);
+        delta[r] = _mm_set1_epi8(rules[r].delta);
+    }
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i out = v;
+        for (int r = 0; r < num_rules; r++) {
+            __m128i t = _mm_sub_epi8(v, lo[r]);
+            __m128i m = _mm_cmpeq_epi8(_mm_min_epu8(t, width[r]), t);
+            out = _mm_or_si128(_mm_and_si128(m, _mm_add_epi8(v, delta[r])), _mm_andnot_si128(m, out));
+        }
+        _mm_storeu_si128((__m128i *) (dst + i), out);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t translate_avx2(const unsigned char *src, unsigned char *dst, size_t n) {
+    __m256i lo[MAX_RULES], width[MAX_RULES], delta[MAX_RULES];
+    for (int r = 0; r < num_rules; r++) {
+        lo[r] = _mm256_set1_epi8(rules[r].lo);
+        width[r] = _mm256_set1_epi8(rules[r].hi - rules[r].lo);
+        delta[r] = _mm256_set1_epi8(rules[r].delta);
+    }
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i out = v;
+        for (int r = 0; r < num_rules; r++) {
+            __m256i t = _mm256_sub_epi8(v, lo[r]);
+            __m256i m = _mm256_cmpeq_epi8(_mm256_min_epu8(t, width[r]), t);
+            out = _mm256_blendv_epi8(out, _mm256_add_epi8(v, delta[r]), m);
+        }
+        _mm256_storeu_si256((__m256i *) (dst + i), out);
+    }
+    return i;
+}
+
+static int have_avx2;
+#endif
+
+// Translates n bytes from src to dst (which may be the same buffer), picking
+// the SIMD kernel when the mapping is small
+static void translate(const unsigned char *src, unsigned char *dst, size_t n) {
+    size_t done = 0;
+    if (num_rules == 0) {
+        if (src != dst) memcpy(dst, src, n);
+        return;
+    }
+#ifdef __x86_64__
+    if (num_rules > 0) {
+        done = have_avx2 ? translate_avx2(src, dst, n) : translate_sse2(src, dst, n);
+    }
+#endif
+    translate_table(src + done, dst + done, n - done);
+}
+
+// -d and -s: delete, translate, then squeeze, in that order. *last is the previous
+// output byte (-1 if none yet) so a squeezed run can continue across blocks.
+// Returns the number of bytes written to dst, never more than n.
+static size_t filter(const unsigned char *src, unsigned char *dst, size_t n, int *last) {
+    size_t out = 0;
+    int prev = *last;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = src[i];
+        if (delete_set[c]) continue;
+        c = table[c];
+        if (squeeze_set[c] && c == prev) continue;
+        dst[out++] = c;
+        prev = c;
+    }
+    *last = prev;
+    return out;
+}
+
+// Writes the whole buffer to fd, retrying on short writes and signals
+static int write_all(int fd, const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Parallel mode (-j N with a regular file on stdin). The file is mapped once and
+// cut into CHUNK_SIZE pieces; workers claim chunks in order and fill a ring of
+// output slots, and the main thread writes the slots back out in chunk order.
+// A worker may only reuse a slot after the writer has drained it, which also
+// bounds memory to 2 * threads chunks.
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t chunk;       // chunk index currently held by this slot
+    int ready;
+} Slot;
+
+static struct {
+    const unsigned char *map;
+    size_t size;
+    size_t num_chunks;
+    size_t next_chunk;  // next chunk a worker will claim
+    size_t written;     // chunks already written by the main thread
+    Slot *slots;
+    size_t num_slots;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    pthread_cond_t slot_ready;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .slot_free = PTHREAD_COND_INITIALIZER,
+          .slot_ready = PTHREAD_COND_INITIALIZER};
+
+static void *worker(void *arg) {
+    (void) arg;
+    while (1) {
+        pthread_mutex_lock(&pool.lock);
+        size_t c = pool.next_chunk;
+        if (c >= pool.num_chunks) {
+            pthread_mutex_unlock(&pool.lock);
+            return NULL;
+        }
+        pool.next_chunk++;
+        // The slot still holds chunk c - num_slots until the writer gets to it
+        while (c >= pool.written + pool.num_slots) {
+            pthread_cond_wait(&pool.slot_free, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        Slot *slot = &pool.slots[c % pool.num_slots];
+        size_t start = c * CHUNK_SIZE;
+        size_t n = pool.size - start < CHUNK_SIZE ? pool.size - start : CHUNK_SIZE;
+        if (filtering) {
+            // Each chunk starts with no previous byte; the writer fixes up runs
+            // that straddle a chunk boundary
+            int last = -1;
+            slot->len = filter(pool.map + start, slot->data, n, &last);
+        }
+        else {
+            translate(pool.map + start, slot->data, n);
+            slot->len = n;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        slot->chunk = c;
+        slot->ready = 1;
+        pthread_cond_broadcast(&pool.slot_ready);
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
+
+static int run_parallel(int fd, size_t size, int threads) {
+    pthread_t tids[MAX_THREADS];
+    int status = 0, prev = -1;
+
+    pool.map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pool.map == MAP_FAILED) return -1;
+    madvise((void *) pool.map, size, MADV_SEQUENTIAL);
+    pool.size = size;
+    pool.num_chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    pool.num_slots = 2 * threads;
+    pool.slots = calloc(pool.num_slots, sizeof(Slot));
+    if (pool.slots == NULL) {
+        munmap((void *) pool.map, size);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t i = 0; i < pool.num_slots; i++) {
+        pool.slots[i].data = malloc(CHUNK_SIZE);
+        if (pool.slots[i].data == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&tids[t], NULL, worker, NULL);
+    }
+
+    for (size_t c = 0; c < pool.num_chunks; c++) {
+        Slot *slot = &pool.slots[c % pool.num_slots];
+        pthread_mutex_lock(&pool.lock);
+        while (!slot->ready || slot->chunk != c) {
+            pthread_cond_wait(&pool.slot_ready, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        unsigned char *data = slot->data;
+        size_t len = slot->len;
+        // A squeezed run that crossed the boundary: the chunk starts with one
+        // more copy of the byte we last wrote, so drop it
+        if (len > 0 && squeeze_set[data[0]] && data[0] == prev) {
+            data++;
+            len--;
+        }
+        if (len > 0) {
+            if (status == 0 && write_all(STDOUT_FILENO, data, len) < 0) status = -1;
+            prev = data[len - 1];
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        slot->ready = 0;
+        pool.written = c + 1;
+        pthread_cond_broadcast(&pool.slot_free);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    for (size_t i = 0; i < pool.num_slots; i++) {
+        free(pool.slots[i].data);
+    }
+    free(pool.slots);
+    munmap((void *) pool.map, size);
+    return status;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-d] [-s] [-j N] <SET1> [SET2]\n", prog);
+    fprintf(stderr, "  -d     delete characters in SET1 instead of translating\n");
+    fprintf(stderr, "  -s     squeeze repeats of characters in the last SET given\n");
+    fprintf(stderr, "  -j N   translate a regular file on stdin with N threads\n");
+    fprintf(stderr, "SETs accept ranges (a-z), classes ([:upper:]) and escapes (\\n, \\t, \\\\, \\ooo)\n");
+}
 
 int main(int argc, char *argv[]) {
-    int c;
-    char old_char, new_char;
+    static unsigned char set1[SET_MAX], set2[SET_MAX];
+    int len1 = 0, len2 = 0;
+    int delete = 0, squeeze = 0, threads = 1;
+    int first, sets;
+    struct stat st;
+    ssize_t n;
+
+    // Options: -d, -s (also combined as -ds/-sd), -j N, and "--" to end them
+    for (first = 1; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+        if (strcmp(argv[first], "--") == 0) {
+            first++;
+            break;
+        }
+        else if (strcmp(argv[first], "-j") == 0 && first + 1 < argc) {
+            threads = atoi(argv[++first]);
+            if (threads < 1 || threads > MAX_THREADS) {
+                fprintf(stderr, "%s: thread count must be between 1 and %d\n", argv[0], MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+        }
+        else {
+            for (const char *f = argv[first] + 1; *f; f++) {
+                if (*f == 'd') delete = 1;
+                else if (*f == 's') squeeze = 1;
+                else {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+    sets = argc - first;
 
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <old_char> <new_char>\n", argv[0]);
+    // -d takes one set (two with -s), -s alone takes one or two, translation takes two
+    if (sets < 1 || sets > 2 || (delete && sets != 1 + squeeze) || (!delete && !squeeze && sets != 2)) {
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    old_char = argv[1][0];
-    new_char = argv[2][0];
+    len1 = expand_set(argv[first], set1);
+    if (sets == 2) {
+        len2 = expand_set(argv[first + 1], set2);
+    }
+    if (!delete && sets == 2 && len2 == 0 && len1 > 0) {
+        fprintf(stderr, "%s: SET2 must be non-empty\n", argv[0]);
+        return EXIT_FAILURE;
+    }
 
-    while ((c = getchar()) != EOF) {
-        if (c == old_char) {
-            c = new_char;
+    if (delete) {
+        for (int i = 0; i < len1; i++) delete_set[set1[i]] = 1;
+        build_table(set1, 0, set2, 0);
+    }
+    else {
+        build_table(set1, sets == 2 ? len1 : 0, set2, len2);
+    }
+    if (squeeze) {
+        const unsigned char *sq = sets == 2 ? set2 : set1;
+        int sq_len = sets == 2 ? len2 : len1;
+        for (int i = 0; i < sq_len; i++) squeeze_set[sq[i]] = 1;
+    }
+    filtering = delete || squeeze;
+    build_rules();
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    if (threads > 1 && fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        // Only the part from the current offset onwards belongs to us
+        off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+        if (offset == 0) {
+            if (run_parallel(STDIN_FILENO, st.st_size, threads) < 0) {
+                perror("Error translating input");
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
         }
-        putchar(c);
     }
 
+    unsigned char *buffer = malloc(BUF_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    int last = -1;
+    while ((n = read(STDIN_FILENO, buffer, BUF_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Error reading input");
+            free(buffer);
+            return EXIT_FAILURE;
+        }
+        // Filtering only ever shrinks the block, so it can also run in place
+        if (filtering) n = filter(buffer, buffer, n, &last);
+        else translate(buffer, buffer, n);
+        if (write_all(STDOUT_FILENO, buffer, n) < 0) {
+            perror("Error writing output");
+            free(buffer);
+            return EXIT_FAILURE;
+        }
+    }
+
+    free(buffer);
+
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
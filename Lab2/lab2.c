@@ -1,33 +1,733 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #define MAX_COMMAND_LENGTH 256
 #define ARGV_MAX 20
+#define HASH_BUCKETS 64
+#define DIR_CHECK_INTERVAL 1.0
 //MAX_COMMAND_LENGTH: the maximum length of the command
 //ARGV_MAX: the maximum number of the input of the argument vector
+//HASH_BUCKETS: number of chains in the table of resolved commands
+//DIR_CHECK_INTERVAL: seconds a PATH directory's mtime is trusted without a stat
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+extern char **environ;
+
+// How commands are started. posix_spawn lets libc use vfork/CLONE_VFORK, so the
+// cost does not grow with the shell's own memory the way copying it in fork() does.
+enum { SPAWN_POSIX, SPAWN_FORK };
+static int spawn_backend = SPAWN_POSIX;
+static const char *backend_names[] = {"posix_spawn", "fork"};
+
+// One remembered command, like an entry of bash's "hash" table
+typedef struct hash_entry {
+    char *name;             // command as typed, e.g. "ls"
+    char *path;             // where it was found, e.g. "/usr/bin/ls"
+    int hits;               // how many times the cached path was used
+    int dir;                // index of its directory in path_dirs
+    struct hash_entry *next;
+} hash_entry;
+
+static hash_entry *hash_table[HASH_BUCKETS];
+
+// The PATH the table was built from, split into directories, with the
+// modification time of each directory and when it was last stat'ed
+static char *cached_path;
+static char **path_dirs;
+static struct timespec *dir_mtimes;
+static double *dir_checked;     // -1 until the first stat
+static int num_dirs;
+
+static unsigned hash_name(const char *name) {
+    unsigned h = 5381;
+    while (*name) {
+        h = h * 33 + (unsigned char) *name++;
+    }
+    return h % HASH_BUCKETS;
+}
+
+// Forget every remembered command (hash -r)
+static void hash_clear(void) {
+    for (int i = 0; i < HASH_BUCKETS; i++) {
+        hash_entry *e = hash_table[i];
+        while (e != NULL) {
+            hash_entry *next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            e = next;
+        }
+        hash_table[i] = NULL;
+    }
+}
+
+// Splits PATH into directories and starts over with an empty table.
+// An empty PATH entry means the current directory, as in other shells.
+static void load_path(const char *path) {
+    for (int i = 0; i < num_dirs; i++) {
+        free(path_dirs[i]);
+    }
+    free(path_dirs);
+    free(dir_mtimes);
+    free(dir_checked);
+    free(cached_path);
+    hash_clear();
+
+    cached_path = strdup(path);
+    num_dirs = 1;
+    for (const char *p = path; *p; p++) {
+        if (*p == ':') num_dirs++;
+    }
+    path_dirs = malloc(num_dirs * sizeof(char *));
+    dir_mtimes = calloc(num_dirs, sizeof(struct timespec));
+    dir_checked = malloc(num_dirs * sizeof(double));
+    if (cached_path == NULL || path_dirs == NULL || dir_mtimes == NULL || dir_checked == NULL) {
+        printf("Memory allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *start = path;
+    for (int i = 0; i < num_dirs; i++) {
+        const char *end = strchr(start, ':');
+        size_t len = end ? (size_t) (end - start) : strlen(start);
+        path_dirs[i] = len == 0 ? strdup(".") : strndup(start, len);
+        dir_checked[i] = -1;
+        start = end ? end + 1 : start + len;
+    }
+}
+
+// Rebuilds the directory list (and so empties the table) if PATH was changed
+static void check_path(void) {
+    const char *path = getenv("PATH");
+    if (path == NULL) path = "/usr/local/bin:/usr/bin:/bin";
+    if (cached_path == NULL || strcmp(path, cached_path) != 0) {
+        load_path(path);
+    }
+}
+
+// A clock read from the vDSO where there is one, so it is not a system call
+static double coarse_seconds(void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Stats those of the first count PATH directories that were last stat'ed more
+// than DIR_CHECK_INTERVAL ago. If the modification time of one has changed, a
+// command was added to, removed from or replaced in it: the table is emptied
+// and 1 returned.
+static int dirs_changed(int count) {
+    double now = coarse_seconds();
+    int changed = 0;
+    for (int i = 0; i < count; i++) {
+        if (dir_checked[i] >= 0 && now - dir_checked[i] < DIR_CHECK_INTERVAL) continue;
+        struct stat st;
+        struct timespec mtime = {0, 0};     // a missing directory
+        if (stat(path_dirs[i], &st) == 0) mtime = st.st_mtim;
+        if (dir_checked[i] >= 0 && (mtime.tv_sec != dir_mtimes[i].tv_sec || mtime.tv_nsec != dir_mtimes[i].tv_nsec)) {
+            changed = 1;
+        }
+        dir_mtimes[i] = mtime;
+        dir_checked[i] = now;
+    }
+    if (changed) hash_clear();
+    return changed;
+}
+
+static int is_executable(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+// Resolves a command name to an executable path, returning NULL if there is none.
+// Names containing '/' are used as they are. Anything else is looked up in the
+// table first. A hit is trusted until PATH changes, "hash -r" is run, starting
+// it fails with ENOENT (see launch_command), or the modification time of its
+// directory or of one before it in PATH changes, so a command added earlier in
+// PATH takes over. Those directories are stat'ed at most once per
+// DIR_CHECK_INTERVAL, so most hits cost no system call at all.
+static const char *find_command(const char *name) {
+    char candidate[PATH_MAX];
+
+    if (strchr(name, '/') != NULL) {
+        return is_executable(name) ? name : NULL;
+    }
+    check_path();
+
+    unsigned bucket = hash_name(name);
+    for (hash_entry *e = hash_table[bucket]; e != NULL; e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            if (dirs_changed(e->dir + 1)) break;    // e is gone with the table
+            e->hits++;
+            return e->path;
+        }
+    }
+
+    // the mtimes are read before the search, so a change during it is not missed
+    dirs_changed(num_dirs);
+    for (int i = 0; i < num_dirs; i++) {
+        snprintf(candidate, sizeof(candidate), "%s/%s", path_dirs[i], name);
+        if (is_executable(candidate)) {
+            hash_entry *e = malloc(sizeof(hash_entry));
+            if (e == NULL) {
+                printf("Memory allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+            e->name = strdup(name);
+            e->path = strdup(candidate);
+            e->hits = 1;
+            e->dir = i;
+            e->next = hash_table[bucket];
+            hash_table[bucket] = e;
+            return e->path;
+        }
+    }
+    return NULL;
+}
+
+// Drops name from the table, after its remembered path turned out to be gone
+static void forget_command(const char *name) {
+    for (hash_entry **p = &hash_table[hash_name(name)]; *p != NULL; p = &(*p)->next) {
+        hash_entry *e = *p;
+        if (strcmp(e->name, name) == 0) {
+            *p = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            return;
+        }
+    }
+}
+
+// The hash builtin: "hash" lists the table, "hash -r" empties it and
+// "hash name..." looks names up and remembers them without running anything
+static void hash_builtin(char **argv) {
+    check_path();
+    if (argv[1] == NULL) {
+        int empty = 1;
+        for (int i = 0; i < HASH_BUCKETS; i++) {
+            for (hash_entry *e = hash_table[i]; e != NULL; e = e->next) {
+                if (empty) printf("hits\tcommand\n");
+                printf("%4d\t%s\n", e->hits, e->path);
+                empty = 0;
+            }
+        }
+        if (empty) printf("hash: hash table empty\n");
+        return;
+    }
+    if (strcmp(argv[1], "-r") == 0) {
+        hash_clear();
+        return;
+    }
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (find_command(argv[i]) == NULL) {
+            printf("hash: %s: not found\n", argv[i]);
+        }
+        else {
+            // Looking a name up is not a use of it
+            hash_entry *e = hash_table[hash_name(argv[i])];
+            while (e != NULL && strcmp(e->name, argv[i]) != 0) e = e->next;
+            if (e != NULL) e->hits--;
+        }
+    }
+}
+
+// Starts path with argv and returns the child's pid, or -1 with errno set,
+// including when the exec itself fails. If out_fd is not -1 it becomes the
+// child's stdout, and with merge_stderr its stderr as well. Those dup2s are the
+// only in-child setup the shell ever needs, and posix_spawn can express them as
+// file actions, so fork() is only used when it is selected explicitly.
+static pid_t launch(const char *path, char **argv, int out_fd, int merge_stderr) {
+    pid_t pid;
+
+    if (spawn_backend == SPAWN_POSIX) {
+        posix_spawn_file_actions_t actions, *ap = NULL;
+        if (out_fd != -1) {
+            posix_spawn_file_actions_init(&actions);
+            posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+            if (merge_stderr) posix_spawn_file_actions_adddup2(&actions, out_fd, STDERR_FILENO);
+            posix_spawn_file_actions_addclose(&actions, out_fd);
+            ap = &actions;
+        }
+        int err = posix_spawn(&pid, path, ap, NULL, argv, environ);
+        if (ap != NULL) posix_spawn_file_actions_destroy(ap);
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+        return pid;
+    }
+
+    // As posix_spawn does, the child reports a failed exec through a
+    // close-on-exec pipe; EOF means the exec succeeded
+    int err_pipe[2], err = 0;
+    if (pipe(err_pipe) != 0) return -1;
+    fcntl(err_pipe[1], F_SETFD, FD_CLOEXEC);
+    pid = fork();
+    if (pid == 0) {
+        // Child process
+        close(err_pipe[0]);
+        if (out_fd != -1) {
+            dup2(out_fd, STDOUT_FILENO);
+            if (merge_stderr) dup2(out_fd, STDERR_FILENO);
+            close(out_fd);
+        }
+        execv(path, argv);
+        err = errno;
+        write(err_pipe[1], &err, sizeof(err));
+        _exit(127);
+    }
+    close(err_pipe[1]);
+    if (pid > 0) {
+        ssize_t n;
+        while ((n = read(err_pipe[0], &err, sizeof(err))) < 0 && errno == EINTR) {
+        }
+        if (n == sizeof(err)) {
+            waitpid(pid, NULL, 0);
+            pid = -1;
+            errno = err;
+        }
+    }
+    close(err_pipe[0]);
+    return pid;
+}
+
+// Resolves argv[0] and starts it as launch does. If the remembered path has
+// gone away (ENOENT), the entry is dropped and PATH is searched once more, so
+// a moved or deleted command is rehashed only when it is actually needed.
+// Fails with ENOENT when the command is not found at all.
+static pid_t launch_command(char **argv, int out_fd, int merge_stderr) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const char *path = find_command(argv[0]);
+        if (path == NULL) {
+            errno = ENOENT;
+            return -1;
+        }
+        pid_t pid = launch(path, argv, out_fd, merge_stderr);
+        if (pid >= 0 || errno != ENOENT || strchr(argv[0], '/') != NULL) return pid;
+        forget_command(argv[0]);
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void print_percentiles(const char *label, double *samples, int n) {
+    qsort(samples, n, sizeof(double), compare_double);
+    printf("  %-11s p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  max %8.1f us\n", label,
+           samples[n / 2] * 1e6, samples[n * 9 / 10] * 1e6, samples[n * 99 / 100] * 1e6,
+           samples[n - 1] * 1e6);
+}
+
+// Benchmark mode: launches the command n times back to back with each backend and
+// reports commands per second plus percentiles for the launch call alone and for
+// the full launch-to-reap round trip. rss_mb inflates the shell's resident memory
+// first, since that is what makes fork() slow.
+static int benchmark(int n, int rss_mb, char **argv) {
+    const char *path = find_command(argv[0]);
+    double *launch_lat = malloc(n * sizeof(double));
+    double *total_lat = malloc(n * sizeof(double));
+    int devnull = open("/dev/null", O_WRONLY);
+
+    if (path == NULL) {
+        printf("%s: command not found\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (launch_lat == NULL || total_lat == NULL) {
+        printf("Memory allocation error\n");
+        return EXIT_FAILURE;
+    }
+    if (rss_mb > 0) {
+        char *ballast = malloc((size_t) rss_mb << 20);
+        if (ballast == NULL) {
+            printf("Memory allocation error\n");
+            return EXIT_FAILURE;
+        }
+        memset(ballast, 1, (size_t) rss_mb << 20); // touch every page
+    }
+
+    printf("%s x %d, shell RSS inflated by %d MB\n", path, n, rss_mb);
+    for (int b = SPAWN_POSIX; b <= SPAWN_FORK; b++) {
+        spawn_backend = b;
+        double start = now_seconds();
+        for (int i = 0; i < n; i++) {
+            double t0 = now_seconds();
+            pid_t pid = launch(path, argv, devnull, 0);
+            double t1 = now_seconds();
+            if (pid < 0) {
+                perror(backend_names[b]);
+                return EXIT_FAILURE;
+            }
+            waitpid(pid, NULL, 0);
+            launch_lat[i] = t1 - t0;
+            total_lat[i] = now_seconds() - t0;
+        }
+        double elapsed = now_seconds() - start;
+        printf("%s: %.0f commands/s\n", backend_names[b], n / elapsed);
+        print_percentiles("launch", launch_lat, n);
+        print_percentiles("round trip", total_lat, n);
+    }
+    free(launch_lat);
+    free(total_lat);
+    close(devnull);
+    return EXIT_SUCCESS;
+}
 
 // Function to split the command into program and arguments
 void parse_command(char *command, char **argv) {
     for (int i = 0; i < ARGV_MAX; i++) {
         argv[i] = strsep(&command, " ");
         if (argv[i] == NULL) break;
-        if (strlen(argv[i]) == 0) i--; 
+        if (strlen(argv[i]) == 0) i--;
         // Skip any empty strings
     }
+    argv[ARGV_MAX - 1] = NULL;
+}
+
+// Builtins that only change shell state; returns 1 if argv was one of them
+static int run_builtin(char **argv) {
+    if (strcmp(argv[0], "cd") == 0) {
+        if (argv[1] == NULL || chdir(argv[1]) == -1) {
+            printf("Error: Failed to change directory to %s\n", argv[1] ? argv[1] : "");
+        }
+        return 1;
+    }
+    if (strcmp(argv[0], "hash") == 0) {
+        hash_builtin(argv);
+        return 1;
+    }
+    // export NAME=VALUE, mainly so PATH can be changed from inside the shell
+    if (strcmp(argv[0], "export") == 0) {
+        for (int i = 1; argv[i] != NULL; i++) {
+            char *eq = strchr(argv[i], '=');
+            if (eq == NULL) continue;
+            *eq = '\0';
+            setenv(argv[i], eq + 1, 1);
+        }
+        return 1;
+    }
+    // spawn [posix|fork] shows or picks the launch backend
+    if (strcmp(argv[0], "spawn") == 0) {
+        if (argv[1] != NULL && strcmp(argv[1], "posix") == 0) spawn_backend = SPAWN_POSIX;
+        else if (argv[1] != NULL && strcmp(argv[1], "fork") == 0) spawn_backend = SPAWN_FORK;
+        else if (argv[1] != NULL) printf("spawn: expected posix or fork\n");
+        printf("launching with %s\n", backend_names[spawn_backend]);
+        return 1;
+    }
+    return 0;
+}
+
+// Writes the whole buffer to fd, retrying on short writes and signals
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+// Batch mode: lab2 -b [-j N] [-o buffered|lines] [script]
+// The whole script (or stdin) is read up front, one command per line, and up to
+// N commands run at once, like xargs -P. Each job's stdout and stderr go to a
+// pipe that the shell polls. In "buffered" mode a job's output is printed in one
+// piece when it finishes; in "lines" mode complete lines are printed as they
+// arrive, prefixed with the script line number, so lines from different jobs
+// interleave but are never torn. Builtins (cd, export, ...) run when dispatch
+// reaches them, so they affect every later line. A summary of exit statuses
+// goes to stderr at the end.
+enum { OUTPUT_BUFFERED, OUTPUT_LINES };
+
+typedef struct {
+    int line;           // script line number
+    char *text;         // the command as written, for the summary
+    pid_t pid;
+    int fd;             // read end of the output pipe, -1 once at EOF
+    int reaped;
+    int status;
+    char *out;          // captured output not yet printed
+    size_t out_len, out_cap;
+} job;
+
+static void job_flush_lines(job *j, int final) {
+    char prefix[32];
+    size_t start = 0;
+    int prefix_len = snprintf(prefix, sizeof(prefix), "[%d] ", j->line);
+    for (size_t i = 0; i < j->out_len; i++) {
+        if (j->out[i] != '\n') continue;
+        write_all(STDOUT_FILENO, prefix, prefix_len);
+        write_all(STDOUT_FILENO, j->out + start, i + 1 - start);
+        start = i + 1;
+    }
+    if (final && start < j->out_len) {
+        write_all(STDOUT_FILENO, prefix, prefix_len);
+        write_all(STDOUT_FILENO, j->out + start, j->out_len - start);
+        write_all(STDOUT_FILENO, "\n", 1);
+        start = j->out_len;
+    }
+    memmove(j->out, j->out + start, j->out_len - start);
+    j->out_len -= start;
 }
 
-int main() {
+// Reads what is available from a job's pipe; returns 0 at EOF
+static int job_read(job *j, int mode) {
+    if (j->out_cap - j->out_len < 4096) {
+        j->out_cap = j->out_cap ? j->out_cap * 2 : 8192;
+        j->out = realloc(j->out, j->out_cap);
+        if (j->out == NULL) {
+            printf("Memory allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ssize_t n = read(j->fd, j->out + j->out_len, j->out_cap - j->out_len);
+    if (n < 0 && errno == EINTR) return 1;
+    if (n <= 0) return 0;
+    j->out_len += n;
+    if (mode == OUTPUT_LINES) job_flush_lines(j, 0);
+    return 1;
+}
+
+static int run_batch(int script_fd, int max_jobs, int mode) {
+    char *script = NULL;
+    size_t len = 0, cap = 0;
+    ssize_t n;
+
+    // Read the whole script in large blocks
+    while (1) {
+        if (cap - len < 65536) {
+            cap = cap ? cap * 2 : 1 << 20;
+            script = realloc(script, cap);
+            if (script == NULL) {
+                printf("Memory allocation error\n");
+                return EXIT_FAILURE;
+            }
+        }
+        n = read(script_fd, script + len, cap - len - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+    }
+    script[len] = '\0';
+
+    int num_lines = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (script[i] == '\n') num_lines++;
+    }
+    job *jobs = calloc(num_lines, sizeof(job));
+    struct pollfd *fds = malloc(max_jobs * sizeof(struct pollfd));
+    job **polled = malloc(max_jobs * sizeof(job *));
+    job **running = malloc(max_jobs * sizeof(job *));
+    if (jobs == NULL || fds == NULL || polled == NULL || running == NULL) {
+        printf("Memory allocation error\n");
+        return EXIT_FAILURE;
+    }
+
+    int num_jobs = 0, num_running = 0, failed = 0, stop = 0;
+    char *cursor = script;
+    int line = 0;
+
+    fflush(stdout);
+    while (1) {
+        // Start jobs until N are running or the script is exhausted
+        while (!stop && num_running < max_jobs && cursor != NULL) {
+            char *text = strsep(&cursor, "\n");
+            char *argv[ARGV_MAX];
+            line++;
+            text[strcspn(text, "\r")] = '\0';
+            if (text[strspn(text, " \t")] == '\0' || text[strspn(text, " \t")] == '#') continue;
+
+            char *copy = strdup(text);
+            parse_command(copy, argv);
+            if (strcmp(argv[0], "exit") == 0) {
+                stop = 1;
+                free(copy);
+                break;
+            }
+            if (run_builtin(argv)) {
+                fflush(stdout);
+                free(copy);
+                continue;
+            }
+
+            job *j = &jobs[num_jobs++];
+            j->line = line;
+            j->text = text;
+            j->fd = -1;
+            int fd[2];
+            if (pipe(fd) != 0) {
+                fprintf(stderr, "[%d] %s: %s\n", line, argv[0], strerror(errno));
+                j->reaped = 1;
+                j->status = 127 << 8;
+                free(copy);
+                continue;
+            }
+            fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+            j->pid = launch_command(argv, fd[1], 1);
+            close(fd[1]);
+            free(copy);
+            if (j->pid < 0) {
+                fprintf(stderr, "[%d] %s: %s\n", line, argv[0], errno == ENOENT ? "command not found" : strerror(errno));
+                close(fd[0]);
+                j->reaped = 1;
+                j->status = 127 << 8;
+                continue;
+            }
+            j->fd = fd[0];
+            running[num_running++] = j;
+        }
+        if (num_running == 0) break;
+
+        // Wait for output from any running job
+        int nfds = 0, waiting_on_exit = 0;
+        for (int i = 0; i < num_running; i++) {
+            if (running[i]->fd != -1) {
+                fds[nfds] = (struct pollfd) {.fd = running[i]->fd, .events = POLLIN};
+                polled[nfds++] = running[i];
+            }
+            else {
+                waiting_on_exit = 1;
+            }
+        }
+        // A job that closed its output but has not exited yet is checked on every tick
+        if (nfds > 0 && poll(fds, nfds, waiting_on_exit ? 10 : -1) > 0) {
+            for (int i = 0; i < nfds; i++) {
+                if (fds[i].revents && !job_read(polled[i], mode)) {
+                    close(polled[i]->fd);
+                    polled[i]->fd = -1;
+                }
+            }
+        }
+        else if (nfds == 0) {
+            // Nothing left to read: block until some job exits
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            for (int i = 0; i < num_running; i++) {
+                if (running[i]->pid == pid) {
+                    running[i]->reaped = 1;
+                    running[i]->status = status;
+                }
+            }
+        }
+
+        // Retire jobs that have both hit EOF and exited
+        for (int i = 0; i < num_running; i++) {
+            job *j = running[i];
+            if (j->fd != -1) continue;
+            if (!j->reaped && waitpid(j->pid, &j->status, WNOHANG) == j->pid) j->reaped = 1;
+            if (!j->reaped) continue;
+
+            if (mode == OUTPUT_LINES) job_flush_lines(j, 1);
+            else {
+                write_all(STDOUT_FILENO, j->out, j->out_len);
+                // end an unterminated last line, as job_flush_lines does, so it
+                // does not run into the next job's output or the summary
+                if (j->out_len > 0 && j->out[j->out_len - 1] != '\n') write_all(STDOUT_FILENO, "\n", 1);
+            }
+            free(j->out);
+            j->out = NULL;
+            running[i--] = running[--num_running];
+        }
+    }
+
+    // Exit status summary
+    for (int i = 0; i < num_jobs; i++) {
+        int st = jobs[i].status;
+        if (WIFEXITED(st) && WEXITSTATUS(st) == 0) continue;
+        if (failed++ == 0) fprintf(stderr, "failed jobs:\n");
+        if (WIFSIGNALED(st)) fprintf(stderr, "  line %d: signal %d: %s\n", jobs[i].line, WTERMSIG(st), jobs[i].text);
+        else fprintf(stderr, "  line %d: exit %d: %s\n", jobs[i].line, WEXITSTATUS(st), jobs[i].text);
+    }
+    fprintf(stderr, "%d jobs, %d succeeded, %d failed\n", num_jobs, num_jobs - failed, failed);
+
+    free(jobs);
+    free(fds);
+    free(polled);
+    free(running);
+    free(script);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int main_argc, char *main_argv[]) {
     char command[MAX_COMMAND_LENGTH];
     char *argv[ARGV_MAX];
-    char path[MAX_COMMAND_LENGTH];
+
+    // lab2 -B N [-m MB] [command args...]: launch-rate benchmark instead of a prompt
+    if (main_argc >= 3 && strcmp(main_argv[1], "-B") == 0) {
+        int n = atoi(main_argv[2]), rss_mb = 0, first = 3;
+        static char *default_command[] = {"true", NULL};
+        if (first + 1 < main_argc && strcmp(main_argv[first], "-m") == 0) {
+            rss_mb = atoi(main_argv[first + 1]);
+            first += 2;
+        }
+        if (n <= 0) {
+            printf("Usage: %s -B <count> [-m MB] [command args...]\n", main_argv[0]);
+            return EXIT_FAILURE;
+        }
+        return benchmark(n, rss_mb, first < main_argc ? &main_argv[first] : default_command);
+    }
+
+    // lab2 -b [-j N] [-o buffered|lines] [script]: run a command file non-interactively
+    if (main_argc >= 2 && strcmp(main_argv[1], "-b") == 0) {
+        int max_jobs = sysconf(_SC_NPROCESSORS_ONLN), mode = OUTPUT_BUFFERED, script_fd = STDIN_FILENO;
+        for (int i = 2; i < main_argc; i++) {
+            if (strcmp(main_argv[i], "-j") == 0 && i + 1 < main_argc) {
+                max_jobs = atoi(main_argv[++i]);
+            }
+            else if (strcmp(main_argv[i], "-o") == 0 && i + 1 < main_argc) {
+                i++;
+                if (strcmp(main_argv[i], "lines") == 0) mode = OUTPUT_LINES;
+                else if (strcmp(main_argv[i], "buffered") == 0) mode = OUTPUT_BUFFERED;
+                else max_jobs = 0;
+            }
+            else if (script_fd == STDIN_FILENO && strcmp(main_argv[i], "-") != 0) {
+                script_fd = open(main_argv[i], O_RDONLY);
+                if (script_fd < 0) {
+                    printf("Error: cannot open %s\n", main_argv[i]);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        if (max_jobs <= 0) {
+            printf("Usage: %s -b [-j N] [-o buffered|lines] [script]\n", main_argv[0]);
+            return EXIT_FAILURE;
+        }
+        return run_batch(script_fd, max_jobs, mode);
+    }
 
     while (1) {
         printf("Shell>> ");
         //Reading the user's input command
-        //reads the user's input into the buffer command with fgets() 
+        //reads the user's input into the buffer command with fgets()
         //If fgets() returns NULL, there is an error reading the user's input
         if (fgets(command, MAX_COMMAND_LENGTH, stdin) == NULL) {
             printf("Command reading error\n");
@@ -49,26 +749,26 @@ int main() {
         }
 
         parse_command(command, argv);
-        if (argv[0][0] != '/') {
-            // Assume command is in /bin/ if no absolute path is provided
-            snprintf(path, sizeof(path), "/bin/%s", argv[0]);
-            argv[0] = path;
+        if (argv[0] == NULL) {
+            continue; // Empty line
         }
 
-        pid_t pid = fork();
-        if (pid == 0) {
-            // Child process
-            if (execv(argv[0], argv) == -1) {
-                printf("Execv error\n");
-                exit(EXIT_FAILURE);
-            }
-        } else if (pid > 0) {
+        if (run_builtin(argv)) {
+            continue;
+        }
+
+        // Resolved through PATH before forking, so unknown commands cost no fork
+        fflush(stdout); // the prompt must not be inherited by a forked child
+        pid_t pid = launch_command(argv, -1, 0);
+        if (pid > 0) {
             // Parent process
-            wait(NULL); // Wait for child process to finish
+            int status;
+            waitpid(pid, &status, 0); // Wait for child process to finish
+        } else if (errno == ENOENT) {
+            printf("%s: command not found\n", argv[0]);
         } else {
-            // Fork failed
-            printf("Fork error\n");
-            exit(EXIT_FAILURE);
+            // Launch failed
+            printf("%s error: %s\n", backend_names[spawn_backend], strerror(errno));
         }
     }
 
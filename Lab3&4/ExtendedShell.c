@@ -1,442 +1,1742 @@
+#define _GNU_SOURCE         // splice, tee and F_SETPIPE_SZ on Linux
+#include "errno.h"
+#include "pthread.h"
 #include "fcntl.h"
+#include "poll.h"
+#include "signal.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
+#include "sys/stat.h"
+#include "sys/ioctl.h"
+#include "sys/resource.h"
 #include "sys/wait.h"
+#include "time.h"
 #include "unistd.h"
 #include <ctype.h> 
 
-#define LINE_SIZE 1024      // max can be 1024 bytes
-#define BUFFER_SIZE 128
-// #define MAX_ARGS 20 
+#define ARENA_BLOCK 65536   // first arena block, in bytes
+#define BUFFER_SIZE 8       // initial number of slots in a growing token list
+
+// one command of a pipeline, as produced by parseLine
+typedef struct {
+    char **argv;            // NULL terminated argument list
+    int argc;
+    char *inFile;           // target of '<', or NULL
+    char *outFile;          // target of '>', or NULL
+} command;
+
+// a whole input line: the commands separated by '|' and whether it ended in '&'
+typedef struct {
+    command *commands;
+    int numOfCommands;
+    int background;
+    int *branchStart;       // fan-out: first command of each branch, plus numOfCommands
+    int numOfBranches;      // 0 for a plain pipeline
+    int timed;              // prefixed with the 'time' builtin
+    const char *timeLog;    // time -o file: also append the report there as JSON
+} commandLine;
+
+// bump allocator for everything parsed out of one line. Allocation is a pointer
+// increment; nothing is freed individually, the whole arena is reset once the
+// line has been executed. A line that does not fit in the current block chains
+// a larger one, and the next reset merges them into a single block so the
+// following lines of that size need no malloc at all.
+typedef struct arenaBlock {
+    struct arenaBlock *next;
+    size_t size;
+    char data[];
+} arenaBlock;
+
+typedef struct {
+    arenaBlock *head;       // block currently allocated from
+    size_t used;            // bytes used in head
+} arena;
+
+void *arenaAlloc(arena *a, size_t size) {
+    size = (size + 15) & ~(size_t) 15;
+    if (a->head == NULL || a->head->size - a->used < size) {
+        size_t blockSize = a->head ? a->head->size * 2 : ARENA_BLOCK;
+        if (blockSize < size) blockSize = size;
+        arenaBlock *block = malloc(sizeof(arenaBlock) + blockSize);
+        if (!block) {
+            fprintf(stderr, "arenaAlloc: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        block->next = a->head;
+        block->size = blockSize;
+        a->head = block;
+        a->used = 0;
+    }
+    void *p = a->head->data + a->used;
+    a->used += size;
+    return p;
+}
 
-// reads a single line from the terminal returns a pointer
-// to the character array or NULL if an error is encountered
+void arenaReset(arena *a) {
+    a->used = 0;
+    if (a->head == NULL || a->head->next == NULL) return;
 
-/*Further explanation about why returning a char pointer ; a C string is represented as a 
-sequence of characters, and it is typically accessed through a pointer to the first character 
-in that sequence. Therefore, when you have a char * pointer in C, it can be used to point to 
-the beginning of a character sequence, which effectively makes it a string.*/
-char *readLine(){
-    int lineLength;
-    char *line = (char *) malloc(sizeof(char) * LINE_SIZE);
-    char c;
-    int count = 0;
-    int cap = LINE_SIZE;
+    size_t total = 0;
+    while (a->head) {
+        arenaBlock *next = a->head->next;
+        total += a->head->size;
+        free(a->head);
+        a->head = next;
+    }
+    arenaAlloc(a, total);
+    a->used = 0;
+}
 
-    while(1){
-        c = getchar();
-        if(c == '\n' || c == EOF){
-            line[count] = '\0';
-            return line;
-        }
+// reads a single line from the terminal into a buffer that is reused for every
+// line, strips the newline and returns a pointer to it, or NULL at end of input
+// or on error. *length is set to the length of the line.
+char *readLine(size_t *length){
+    static char *line = NULL;
+    static size_t cap = 0;
 
-        if(count == cap){
-            cap += LINE_SIZE;
-            line = (char *) realloc(line, cap);
-            if(line == NULL){
-                fprintf(stderr, "readLine: cannot allocate memory\n");
-                return NULL;
-            }
-        }
+    ssize_t count = getline(&line, &cap, stdin);
+    if(count < 0){
+        return NULL;
+    }
+    if(count > 0 && line[count - 1] == '\n'){
+        line[--count] = '\0';
+    }
+    *length = count;
+    return line;
+}
 
-        line[count++] = c;
+// value of the character following a backslash inside quotes
+static char escapeChar(char c) {
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'v': return '\v';
+        case 'b': return '\b';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'a': return '\a';
+        case '0': return '\0';
+        default: return c;  // \\, \" and \' stand for themselves
     }
+}
 
-    return line;
+// appends item to a list of pointers living in the arena, doubling it when full
+static void *listPush(arena *a, void *list, int count, int *cap, size_t itemSize, const void *item) {
+    if (count == *cap) {
+        void *bigger = arenaAlloc(a, 2 * *cap * itemSize);
+        memcpy(bigger, list, count * itemSize);
+        list = bigger;
+        *cap *= 2;
+    }
+    memcpy((char *) list + count * itemSize, item, itemSize);
+    return list;
 }
 
-// obtains user input line and splits up into multiple commands separated by pipes
-// returns a double pointer to a string array, each entry containing the string 
-// associated with a single command in the pipe
+// splits a line into the commands of a pipeline and their words in a single
+// left-to-right pass. Quotes group words ("a b" is one word, and a '|' inside
+// quotes is not a pipe), a backslash outside quotes makes the next character
+// literal, and inside quotes \n, \t, \v, \b, \r, \f, \a, \0 and \\ are
+// interpreted. '<' and '>' take the next word as a file name and '&' marks the
+// line as a background job; none of them needs spaces around it.
+// "producer |& { c1 ; c2 | c3 }" fans the producer's output out to several
+// branches, each a pipeline of its own; it has to end the line.
+// The unquoted text of every word is copied into one arena buffer, which can
+// never need more than length + 1 bytes, and the line itself is left unchanged.
+// Returns 0, or -1 after printing a message if the line has a syntax error.
 /*
 I/O example:
 input:
-    line = "cmd1 < inputFile.txt | cmd2 | cmd3 arg1 arg2 &"
-    numOfCommands is not initialized, it will be calculated and returned by reference
+    line = "cmd1 < inputFile.txt | cmd2 \"a|b\" | cmd3 arg1 arg2 &"
 output:
-    numOfCommands = 3
-    return value = 
+    result->numOfCommands = 3
+    result->background = 1
+    result->numOfBranches = 0
+    result->commands =
     {
-        "cmd1 < inputFile.txt",
-        "cmd2",
-        "cmd3 arg1 arg2 &"
+        { argv = { "cmd1" }, inFile = "inputFile.txt" },
+        { argv = { "cmd2", "a|b" } },
+        { argv = { "cmd3", "arg1", "arg2" } }
+    }
+
+I/O example 2:
+input:
+    line = "cat log |& { grep x > a ; sort | uniq -c }"
+output:
+    result->numOfCommands = 4
+    result->numOfBranches = 2
+    result->branchStart = { 1, 2, 4 }
+    result->commands =
+    {
+        { argv = { "cat", "log" } },
+        { argv = { "grep", "x" }, outFile = "a" },
+        { argv = { "sort" } },
+        { argv = { "uniq", "-c" } }
     }
 */
-// Splits a command line into separate commands based on the pipe '|' character
-// and returns an array of commands.
-char **splitLine(char *line, int *numOfCommands) {
-    int bufsize = BUFFER_SIZE; 
-    int position = 0; 
-    char **tokens = malloc(bufsize * sizeof(char*)); // Malloc buffer size * size of char*
-    char *token; // Pointer to store each token found by strtok
-
-    // Fail check
-    if (!tokens) {
-        fprintf(stderr, "splitLine: allocation error\n");
-        exit(EXIT_FAILURE);
+int parseLine(const char *line, size_t length, arena *a, commandLine *result) {
+    const char *p = line;
+    char *text = arenaAlloc(a, length + 1);
+    int commandCap = BUFFER_SIZE, wordCap = BUFFER_SIZE, branchCap = BUFFER_SIZE;
+    char **words = arenaAlloc(a, wordCap * sizeof(char *));
+    command current = { NULL, 0, NULL, NULL };
+    char redirect = 0;  // '<' or '>' while waiting for its file name
+    char lastOp = 0;    // the operator that ended the previous command
+    int fanOut = 0;     // 1 inside the braces of a fan-out, 2 after them
+
+    result->commands = arenaAlloc(a, commandCap * sizeof(command));
+    result->numOfCommands = 0;
+    result->background = 0;
+    result->timed = 0;
+    result->timeLog = NULL;
+    result->branchStart = arenaAlloc(a, branchCap * sizeof(int));
+    result->numOfBranches = 0;
+
+    while (1) {
+        while (*p == ' ' || *p == '\t') p++;
+
+        if (*p == '|' || *p == '\0' || (fanOut == 1 && (*p == ';' || *p == '}'))) {
+            char op = *p;
+            if (redirect) {
+                fprintf(stderr, "syntax error: missing file name after '%c'\n", redirect);
+                return -1;
+            }
+            if (op == '|' && fanOut == 2) {
+                fprintf(stderr, "syntax error: a fan-out has to end the line\n");
+                return -1;
+            }
+            if (current.argc > 0) {
+                char *end = NULL;
+                words = listPush(a, words, current.argc, &wordCap, sizeof(char *), &end);
+                current.argv = words;
+                result->commands = listPush(a, result->commands, result->numOfCommands++, &commandCap, sizeof(command), &current);
+            }
+            else if (op == '}' && lastOp == ';') {
+                result->numOfBranches--;  // "{ a ; b ; }": the last ';' opened no branch
+            }
+            else if (op != '\0' || current.inFile || current.outFile || (result->numOfCommands > 0 && fanOut != 2)) {
+                // an empty line, or nothing after the '}', is fine; an empty stage is not
+                fprintf(stderr, "syntax error: empty command in pipeline\n");
+                return -1;
+            }
+
+            if (op == '\0') {
+                if (fanOut == 1) {
+                    fprintf(stderr, "syntax error: missing '}'\n");
+                    return -1;
+                }
+                if (fanOut) {
+                    result->branchStart = listPush(a, result->branchStart, result->numOfBranches, &branchCap, sizeof(int), &result->numOfCommands);
+                }
+                return 0;
+            }
+            if (op == '|' && p[1] == '&') {
+                if (fanOut) {
+                    fprintf(stderr, "syntax error: nested fan-out\n");
+                    return -1;
+                }
+                p += 2;
+                while (*p == ' ' || *p == '\t') p++;
+                if (*p != '{') {
+                    fprintf(stderr, "syntax error: expected '{' after '|&'\n");
+                    return -1;
+                }
+                fanOut = 1;
+                op = '{';
+            }
+            if (op == '{' || op == ';') {
+                // a new branch starts with the next command
+                result->branchStart = listPush(a, result->branchStart, result->numOfBranches++, &branchCap, sizeof(int), &result->numOfCommands);
+            }
+            else if (op == '}') {
+                fanOut = 2;
+            }
+            p++;
+            lastOp = op;
+            wordCap = BUFFER_SIZE;
+            words = arenaAlloc(a, wordCap * sizeof(char *));
+            current = (command) { NULL, 0, NULL, NULL };
+            continue;
+        }
+        if (*p == '<' || *p == '>') {
+            if (redirect) {
+                fprintf(stderr, "syntax error: missing file name after '%c'\n", redirect);
+                return -1;
+            }
+            redirect = *p++;
+            continue;
+        }
+        if (*p == '&') {
+            result->background = 1;
+            p++;
+            continue;
+        }
+        if (fanOut == 2) {
+            fprintf(stderr, "syntax error: a fan-out has to end the line\n");
+            return -1;
+        }
+
+        // a word: copy it unquoted into text
+        char *word = text;
+        while (*p && *p != ' ' && *p != '\t' && *p != '|' && *p != '<' && *p != '>' && *p != '&' &&
+               !(fanOut == 1 && (*p == ';' || *p == '}'))) {
+            if (*p == '\\') {
+                if (p[1]) p++;
+                *text++ = *p++;
+            }
+            else if (*p == '\'' || *p == '"') {
+                char quote = *p++;
+                while (*p && *p != quote) {
+                    if (*p == '\\' && p[1]) {
+                        *text++ = escapeChar(p[1]);
+                        p += 2;
+                    }
+                    else {
+                        *text++ = *p++;
+                    }
+                }
+                if (*p != quote) {
+                    fprintf(stderr, "syntax error: unterminated %c\n", quote);
+                    return -1;
+                }
+                p++;
+            }
+            else {
+                *text++ = *p++;
+            }
+        }
+        *text++ = '\0';
+
+        if (redirect == '<') current.inFile = word;
+        else if (redirect == '>') current.outFile = word;
+        else words = listPush(a, words, current.argc++, &wordCap, sizeof(char *), &word);
+        redirect = 0;
     }
-    // Strtok() to split by pipe character
-    token = strtok(line, "|");
-    
-    
-    while (token != NULL) { // Continue until no more tokens are found
-        tokens[position++] = token; // Assign the token to the current position in the array
+}
+
 
-        // Resize function
-        if (position >= bufsize) {
-            bufsize += BUFFER_SIZE; 
-            tokens = realloc(tokens, bufsize * sizeof(char*)); 
-            // Fail check
-            if (!tokens) {
-                fprintf(stderr, "splitLine error:\n");
-                exit(EXIT_FAILURE);
+// in-process stages. cat, head, tee and wc run as a thread inside the shell
+// instead of a forked process when they appear in a pipeline, and move data
+// with splice(2)/tee(2) where the kernel allows it, so `cat file | ...` and
+// similar trivial stages cost neither a process nor a copy through user space.
+// A thread cannot be signalled, so ^C, kill %n, fg and bg reach a job through
+// its process group: its forked stages, or, when none of them is sure to
+// outlive its threads, one forked helper that only holds the group (see
+// startHelper). When the helper or a stage is killed by a signal other than
+// SIGPIPE, the job's threads are cancelled: they check a flag between chunks
+// and end without output, with the status of the killed process. A stage
+// only runs in-process when every chunk it waits for is sure to come: every
+// file it reads, tees into or is redirected to is a regular file, and it does
+// not read the shell's own stdin. Other stages, and any with options we do
+// not implement, are exec'd as usual.
+#define PIPE_SIZE (1 << 20)     // pipe capacity requested with F_SETPIPE_SZ
+#define COPY_CHUNK (1 << 20)    // largest single splice or read
+
+typedef struct {
+    char **argv;            // private copy, the line's arena is reset while we run
+    int argc;
+    int inFD, outFD;        // owned by the stage, closed when it ends
+    int *fanOut;            // for the fan-out stage: one output per branch
+    int numOfFanOut;
+    int status;             // exit code
+    struct timespec end;
+    struct rusage usage;
+    int finished;           // set last, with release ordering, by the thread
+    int cancelled;          // set by the SIGCHLD handler when the job is killed
+} builtinStage;
+
+static __thread builtinStage *currentStage;    // the stage this thread runs
+
+// whether the job of the calling in-process stage has been killed
+static int stageCancelled(void) {
+    return currentStage && __atomic_load_n(&currentStage->cancelled, __ATOMIC_RELAXED);
+}
+
+static int writeAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// copies up to limit bytes (all of it if limit < 0) from in to out, with
+// splice when one side is a pipe and read/write otherwise. Returns 0 or -1.
+static int copyData(int in, int out, long long limit) {
+    char *buf = NULL;
+    int useSplice = 1;
+    int result = 0;
+
+    while (limit != 0) {
+        if (stageCancelled()) {
+            result = -1;
+            break;
+        }
+        size_t want = limit < 0 || limit > COPY_CHUNK ? COPY_CHUNK : (size_t) limit;
+        ssize_t n;
+#ifdef __linux__
+        if (useSplice) {
+            n = splice(in, NULL, out, NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                useSplice = 0;  // neither side is a pipe, or the fs does not support it
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            (void) useSplice;
+            if (!buf && !(buf = malloc(COPY_CHUNK))) {
+                result = -1;
+                break;
             }
+            n = read(in, buf, want);
+            if (n > 0 && writeAll(out, buf, n) < 0) n = -1;
         }
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            result = n;
+            break;
+        }
+        if (limit > 0) limit -= n;
+    }
+    free(buf);
+    return result;
+}
 
-        // Find the next token
-        token = strtok(NULL, "|");
+// opens each file argument in turn (or uses in when there is none) and hands
+// it to fn; returns 1 if any file failed
+static int forEachInput(const char *cmdName, char **files, int numOfFiles, int in, int (*fn)(int fd, const char *name, void *arg), void *arg) {
+    int failed = 0;
+    if (numOfFiles == 0) return fn(in, NULL, arg) != 0;
+    for (int i = 0; i < numOfFiles; i++) {
+        int fd = open(files[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            dprintf(STDERR_FILENO, "%s: %s: %s\n", cmdName, files[i], strerror(errno));
+            failed = 1;
+            continue;
+        }
+        if (fn(fd, files[i], arg) != 0) failed = 1;
+        close(fd);
     }
-    tokens[position] = NULL; 
-    *numOfCommands = position; 
-    return tokens; 
+    return failed;
 }
 
+static int catFile(int fd, const char *name, void *out) {
+    (void) name;
+    return copyData(fd, *(int *) out, -1);
+}
 
-// obtains a single string representing a command
-// parses the words of the command into tokens and strips
-// any single or double quotes around any one word
-// NOTE: arguments surrounded by double or single quotes
-// are considered one argument or one token; meaning:
-// cmd1 "input string" has two tokens, not 3.
-/*
-I/O example1:
-input:
-    command = "cmd3 arg1 arg2 &"
-    numOfWords is not initialized, it will be calculated and returned by reference
-output:
-    numOfWords = 4
-    return value =
-    {
-        "cmd3",
-        "arg1",
-        "arg2",
-        "&"
+typedef struct {
+    int out;
+    int lines, words, bytes;        // which counts to print
+    long long count[3], total[3];
+    int numOfFiles;
+} wcState;
+
+static int wcFile(int fd, const char *name, void *arg) {
+    wcState *wc = arg;
+    long long lines = 0, words = 0, bytes = 0;
+    int inWord = 0;
+    char line[128];
+    struct stat st;
+
+    if (!wc->lines && !wc->words && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        bytes = st.st_size;  // byte count of a plain file needs no reading
+    }
+    else {
+        char *buf = malloc(COPY_CHUNK);
+        ssize_t n;
+        if (!buf) return -1;
+        while ((n = read(fd, buf, COPY_CHUNK)) != 0) {
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 || stageCancelled()) {
+                free(buf);
+                return -1;
+            }
+            bytes += n;
+            for (char *p = buf, *end = buf + n; (p = memchr(p, '\n', end - p)); p++) lines++;
+            if (wc->words) {
+                for (ssize_t i = 0; i < n; i++) {
+                    int space = isspace((unsigned char) buf[i]);
+                    if (!space && !inWord) words++;
+                    inWord = !space;
+                }
+            }
+        }
+        free(buf);
     }
 
-I/O example 2:
-input:
-    command = echo "Hello world"
-    numOfWords is not initialized, it will be calculated and returned by reference
-output:
-    numOfWords = 2
-    return value = 
+    if (stageCancelled()) return -1;
+    long long counts[3] = { lines, words, bytes };
+    int shown[3] = { wc->lines, wc->words, wc->bytes };
+    int len = 0;
+    for (int i = 0; i < 3; i++) {
+        wc->total[i] += counts[i];
+        if (shown[i]) len += snprintf(line + len, sizeof(line) - len, " %7lld", counts[i]);
+    }
+    snprintf(line + len, sizeof(line) - len, "%s%s\n", name ? " " : "", name ? name : "");
+    return writeAll(wc->out, line, strlen(line));
+}
+
+// the fan-out stage: copies in to every output. Between pipes on Linux each
+// output gets the data with tee(2), which references the input's pages
+// without consuming them, and the input is only drained (spliced to
+// /dev/null) once every branch has received it. ahead[i] counts the bytes
+// branch i has been given that are still in the input, and a branch is only
+// teed again once it is level with the input's head, so a slow branch holds
+// back the producer but never loses or repeats data. A branch whose reader
+// has gone (EPIPE) is dropped; the stage ends when the input does or when no
+// branch is left. Returns 0, or 1 if any branch failed for another reason.
+static int runFanOut(int in, int *outs, int numOfOuts) {
+    int status = 0, remaining = numOfOuts;
+#ifdef __linux__
+    long long *ahead = calloc(numOfOuts, sizeof(long long));
+    struct pollfd *fds = malloc((numOfOuts + 1) * sizeof(struct pollfd));
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    struct stat st;
+    int pipes = ahead && fds && devnull >= 0 && fstat(in, &st) == 0 && S_ISFIFO(st.st_mode);
+    for (int i = 0; pipes && i < numOfOuts; i++) {
+        pipes = fstat(outs[i], &st) == 0 && S_ISFIFO(st.st_mode);
+    }
+
+    while (pipes && remaining > 0 && !stageCancelled()) {
+        int progress = 0, eof = 0;
+        for (int i = 0; i < numOfOuts; i++) {
+            if (outs[i] < 0 || ahead[i] > 0) continue;
+            ssize_t n = tee(in, outs[i], COPY_CHUNK, SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                ahead[i] = n;
+                progress = 1;
+            }
+            else if (n == 0) {
+                eof = 1;  // the input is empty and has no writers left
+            }
+            else if (errno != EAGAIN && errno != EINTR) {
+                if (errno != EPIPE) status = 1;
+                close(outs[i]);
+                outs[i] = -1;
+                remaining--;
+            }
+        }
+        if (eof) break;
+
+        // drain what every remaining branch already has
+        long long level = -1;
+        for (int i = 0; i < numOfOuts; i++) {
+            if (outs[i] >= 0 && (level < 0 || ahead[i] < level)) level = ahead[i];
+        }
+        if (level > 0) {
+            for (long long left = level; left > 0;) {
+                ssize_t n = splice(in, NULL, devnull, NULL, left, SPLICE_F_MOVE);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    pipes = 0;
+                    status = 1;
+                    break;
+                }
+                left -= n;
+            }
+            for (int i = 0; i < numOfOuts; i++) ahead[i] -= level;
+            progress = 1;
+        }
+        if (progress || remaining == 0) continue;
+
+        // nothing moved: wait for input, or for room in a branch that is level
+        int numOfFds = 0, pending = 0;
+        if (ioctl(in, FIONREAD, &pending) != 0 || pending == 0) {
+            fds[numOfFds++] = (struct pollfd) { .fd = in, .events = POLLIN };
+        }
+        else {
+            for (int i = 0; i < numOfOuts; i++) {
+                if (outs[i] >= 0 && ahead[i] == 0) fds[numOfFds++] = (struct pollfd) { .fd = outs[i], .events = POLLOUT };
+            }
+        }
+        poll(fds, numOfFds, -1);
+    }
+    free(ahead);
+    free(fds);
+    if (devnull >= 0) close(devnull);
+    if (!pipes && remaining > 0 && status == 0)
+#endif
     {
-        "echo",
-        "Hello world"
+        // portable version: one read, then a blocking write to each branch
+        char *buf = malloc(COPY_CHUNK);
+        ssize_t n;
+        while (buf && remaining > 0 && (n = read(in, buf, COPY_CHUNK)) != 0) {
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 || stageCancelled()) {
+                status = 1;
+                break;
+            }
+            for (int i = 0; i < numOfOuts; i++) {
+                if (outs[i] >= 0 && writeAll(outs[i], buf, n) < 0) {
+                    if (errno != EPIPE) status = 1;
+                    close(outs[i]);
+                    outs[i] = -1;
+                    remaining--;
+                }
+            }
+        }
+        free(buf);
     }
-*/
-// Parses a single command into tokens, taking into account quoted strings
-// and returns an array of tokens/words found in the command.
-// Parses a single command into tokens, taking into account quoted strings
-// and now also ignores backslashes.
-char **parseCommand(char *command, int *numOfWords) {
-    int bufsize = BUFFER_SIZE;
-    int position = 0;
-    char **tokens = malloc(bufsize * sizeof(char*));
-    char *token;
-    char *cursor;
-    int inSingleQuote = 0, inDoubleQuote = 0;
-
-    if (!tokens) {
-        fprintf(stderr, "parseCommand: allocation error\n");
-        exit(EXIT_FAILURE);
+    for (int i = 0; i < numOfOuts; i++) {
+        if (outs[i] >= 0) close(outs[i]);
     }
+    return status;
+}
 
-    cursor = command;
-    while (*cursor) {
-        while (*cursor && isspace((unsigned char)*cursor)) cursor++;
+// runs one in-process stage; returns its exit code
+static int runBuiltin(char **argv, int argc, int in, int out) {
+    if (strcmp(argv[0], "cat") == 0) {
+        return forEachInput("cat", argv + 1, argc - 1, in, catFile, &out);
+    }
 
-        if (!*cursor) break;
-        token = cursor;
+    if (strcmp(argv[0], "head") == 0) {
+        long long lines = 10, bytes = -1;
+        int i = 1;
+        for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+            if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) lines = atoll(argv[++i]);
+            else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) bytes = atoll(argv[++i]);
+            else lines = atoll(argv[i] + 1);
+        }
+        // a named file is ours to close; builtinThread only closes the stage's inFD
+        int file = -1, status = 0;
+        if (i < argc) {
+            in = file = open(argv[i], O_RDONLY | O_CLOEXEC);
+            if (in < 0) {
+                dprintf(STDERR_FILENO, "head: %s: %s\n", argv[i], strerror(errno));
+                return 1;
+            }
+        }
+        if (bytes >= 0) {
+            status = copyData(in, out, bytes) != 0;
+        }
+        else {
+            // lines have to be looked at; head normally passes little data anyway
+            char *buf = malloc(COPY_CHUNK);
+            ssize_t n;
+            if (!buf) status = 1;
+            while (buf && lines > 0 && (n = read(in, buf, COPY_CHUNK)) != 0) {
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 || stageCancelled()) {
+                    status = 1;
+                    break;
+                }
+                char *p = buf, *end = buf + n;
+                while (lines > 0 && (p = memchr(p, '\n', end - p))) {
+                    p++;
+                    lines--;
+                }
+                if (writeAll(out, buf, (lines > 0 ? end : p) - buf) < 0) break;
+            }
+            free(buf);
+        }
+        if (file >= 0) close(file);
+        return status;
+    }
 
-        while (*cursor) {
-            if (*cursor == '\\' && !(inSingleQuote || inDoubleQuote)) {
-                // If we encounter a backslash outside quotes, skip it and move to the next character.
-                cursor++;
-                continue;
-            } else if (*cursor == '\\' && (inSingleQuote || inDoubleQuote))
-            {
-                // If we encounter a backslash inside quotes,interpret the special characters.
-                if (*(cursor + 1) == 'n') {
-                    *cursor = '\n';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else if (*(cursor + 1) == 't') {
-                    *cursor = '\t';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else if (*(cursor + 1) == 'v') {
-                    *cursor = '\v';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else if (*(cursor + 1) == 'b') {
-                    *cursor = '\b';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else if (*(cursor + 1) == 'r') {
-                    *cursor = '\r';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else if (*(cursor + 1) == 'f') {
-                    *cursor = '\f';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else if (*(cursor + 1) == 'a') {
-                    *cursor = '\a';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else if (*(cursor + 1) == '0') {
-                    *cursor = '\0';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else if (*(cursor + 1) == '\\') {
-                    *cursor = '\\';
-                    memmove(cursor + 1, cursor + 2, strlen(cursor + 2) + 1);
-                } else {
-                    memmove(cursor, cursor + 1, strlen(cursor));
+    if (strcmp(argv[0], "tee") == 0) {
+        int append = argc > 1 && strcmp(argv[1], "-a") == 0;
+        int numOfFiles = argc - 1 - append;
+        int *files = malloc((numOfFiles + 1) * sizeof(int));
+        int status = 0;
+        if (!files) return 1;
+        for (int i = 0; i < numOfFiles; i++) {
+            files[i] = open(argv[1 + append + i], O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+            if (files[i] < 0) {
+                dprintf(STDERR_FILENO, "tee: %s: %s\n", argv[1 + append + i], strerror(errno));
+                free(files);
+                return 1;
+            }
+        }
+
+#ifdef __linux__
+        // pipe to pipe with one file: tee(2) duplicates the input into the
+        // output without consuming it, then the same bytes are spliced to the
+        // file. splice(2) refuses O_APPEND files, so -a always reads and writes.
+        struct stat inStat, outStat;
+        if (!append && numOfFiles == 1 && fstat(in, &inStat) == 0 && fstat(out, &outStat) == 0 &&
+            S_ISFIFO(inStat.st_mode) && S_ISFIFO(outStat.st_mode)) {
+            int fallback = 0;
+            while (!status && !fallback) {
+                if (stageCancelled()) {
+                    status = 1;
+                    break;
+                }
+                ssize_t n = tee(in, out, COPY_CHUNK, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    status = n < 0;
+                    break;
+                }
+                while (n > 0) {
+                    ssize_t moved = splice(in, NULL, files[0], NULL, n, SPLICE_F_MOVE);
+                    if (moved < 0 && errno == EINTR) continue;
+                    if (moved < 0 && errno == EINVAL) {
+                        // the file system does not take splices: the bytes already
+                        // teed to out still have to reach the file, then the
+                        // loop below handles the rest
+                        status = copyData(in, files[0], n) != 0;
+                        fallback = 1;
+                        break;
+                    }
+                    if (moved <= 0) {
+                        status = 1;
+                        break;
+                    }
+                    n -= moved;
                 }
-            } 
-            
-            if (*cursor == '\'' && !inDoubleQuote) {
-                inSingleQuote = !inSingleQuote;
-                memmove(cursor, cursor + 1, strlen(cursor));
-            } else if (*cursor == '\"' && !inSingleQuote) {
-                inDoubleQuote = !inDoubleQuote;
-                memmove(cursor, cursor + 1, strlen(cursor));
-            } else if (isspace((unsigned char)*cursor) && !inSingleQuote && !inDoubleQuote) {
+            }
+            if (!fallback || status) {
+                close(files[0]);
+                free(files);
+                return status;
+            }
+        }
+#endif
+        char *buf = malloc(COPY_CHUNK);
+        ssize_t n;
+        if (!buf) status = 1;
+        while (buf && (n = read(in, buf, COPY_CHUNK)) != 0) {
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 || stageCancelled()) {
+                status = 1;
                 break;
-            } else {
-                cursor++;
             }
+            if (writeAll(out, buf, n) < 0) status = 1;
+            for (int i = 0; i < numOfFiles; i++) {
+                if (writeAll(files[i], buf, n) < 0) status = 1;
+            }
+            if (status) break;
         }
+        for (int i = 0; i < numOfFiles; i++) close(files[i]);
+        free(files);
+        free(buf);
+        return status;
+    }
 
-        if (position >= bufsize) {
-            bufsize += BUFFER_SIZE;
-            tokens = realloc(tokens, bufsize * sizeof(char*));
-            if (!tokens) {
-                fprintf(stderr, "parseCommand error: \n");
-                exit(EXIT_FAILURE);
+    if (strcmp(argv[0], "wc") == 0) {
+        wcState wc = { .out = out };
+        int i = 1;
+        for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+            for (char *c = argv[i] + 1; *c; c++) {
+                if (*c == 'l') wc.lines = 1;
+                else if (*c == 'w') wc.words = 1;
+                else if (*c == 'c') wc.bytes = 1;
             }
         }
+        if (!wc.lines && !wc.words && !wc.bytes) wc.lines = wc.words = wc.bytes = 1;
+        wc.numOfFiles = argc - i;
+        int status = forEachInput("wc", argv + i, argc - i, in, wcFile, &wc);
+        if (wc.numOfFiles > 1 && !stageCancelled()) {
+            char line[128];
+            int shown[3] = { wc.lines, wc.words, wc.bytes }, len = 0;
+            for (int k = 0; k < 3; k++) {
+                if (shown[k]) len += snprintf(line + len, sizeof(line) - len, " %7lld", wc.total[k]);
+            }
+            snprintf(line + len, sizeof(line) - len, " total\n");
+            writeAll(out, line, strlen(line));
+        }
+        return status;
+    }
+    return 127;
+}
+
+// whether path is a regular file, or (for a file tee will create) missing;
+// anything else, such as /dev/zero or a fifo, may never end or never drain
+static int boundedFile(const char *path, int mayBeMissing) {
+    struct stat st;
+    if (stat(path, &st) != 0) return mayBeMissing && errno == ENOENT;
+    return S_ISREG(st.st_mode);
+}
 
-        tokens[position++] = token;
-        if (*cursor) {
-            *cursor = '\0';
-            cursor++;
+// whether cmd can run in-process: one of our builtins, only options we
+// implement, and reading or writing only pipes, the terminal and regular
+// files (see the in-process stages comment)
+static int isBuiltinStage(command *cmd, int inFD) {
+    char **argv = cmd->argv;
+    int readsStdin = inFD == STDIN_FILENO && !cmd->inFile;
+    int i = 1;
+
+    if (cmd->inFile && !boundedFile(cmd->inFile, 0)) return 0;
+    if (cmd->outFile && !boundedFile(cmd->outFile, 1)) return 0;
+
+    if (strcmp(argv[0], "cat") == 0) {
+        for (; argv[i]; i++) {
+            if (argv[i][0] == '-' || !boundedFile(argv[i], 0)) return 0;
+        }
+        return !(readsStdin && cmd->argc == 1);
+    }
+    if (strcmp(argv[0], "head") == 0) {
+        for (; argv[i] && argv[i][0] == '-' && argv[i][1]; i++) {
+            if ((strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-c") == 0) && argv[i + 1]) i++;
+            else if (strspn(argv[i] + 1, "0123456789") != strlen(argv[i] + 1)) return 0;
+        }
+        if (i < cmd->argc && !boundedFile(argv[i], 0)) return 0;
+        return cmd->argc - i <= 1 && !(readsStdin && cmd->argc == i);
+    }
+    if (strcmp(argv[0], "tee") == 0) {
+        if (argv[1] && strcmp(argv[1], "-a") == 0) i++;
+        for (; argv[i]; i++) {
+            if (argv[i][0] == '-' || !boundedFile(argv[i], 1)) return 0;
+        }
+        return !readsStdin;
+    }
+    if (strcmp(argv[0], "wc") == 0) {
+        for (; argv[i] && argv[i][0] == '-'; i++) {
+            if (argv[i][1] == '\0' || strspn(argv[i] + 1, "lwc") != strlen(argv[i] + 1)) return 0;
         }
+        for (int k = i; argv[k]; k++) {
+            if (argv[k][0] == '-' || !boundedFile(argv[k], 0)) return 0;
+        }
+        return !(readsStdin && cmd->argc == i);
     }
+    return 0;
+}
 
-    tokens[position] = NULL;
-    *numOfWords = position;
-    return tokens;
+static void *builtinThread(void *arg) {
+    builtinStage *stage = arg;
+    currentStage = stage;
+    if (stage->fanOut) stage->status = runFanOut(stage->inFD, stage->fanOut, stage->numOfFanOut);
+    else stage->status = runBuiltin(stage->argv, stage->argc, stage->inFD, stage->outFD);
+
+    // closing our ends is what lets the neighbouring stages see EOF or EPIPE
+    if (stage->inFD != STDIN_FILENO) close(stage->inFD);
+    if (stage->outFD != STDOUT_FILENO && stage->outFD >= 0) close(stage->outFD);
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &stage->usage);
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &stage->end);
+
+    // the SIGCHLD handler collects finished stages along with child processes;
+    // this thread was created with SIGCHLD blocked, so the main thread takes it
+    __atomic_store_n(&stage->finished, 1, __ATOMIC_RELEASE);
+    kill(getpid(), SIGCHLD);
+    return NULL;
 }
 
+// starts cmd as a detached thread that owns inFD and outFD (or, for the
+// fan-out stage, the numOfFanOut descriptors in fanOut); returns the stage,
+// or NULL if it could not be started (the descriptors are then still ours)
+static builtinStage *startBuiltin(command *cmd, int inFD, int outFD, int *fanOut, int numOfFanOut) {
+    size_t size = (cmd->argc + 1) * sizeof(char *);
+    for (int i = 0; i < cmd->argc; i++) size += strlen(cmd->argv[i]) + 1;
+
+    builtinStage *stage = calloc(1, sizeof(builtinStage));
+    char **argv = malloc(size);
+    if (!stage || !argv) {
+        free(stage);
+        free(argv);
+        return NULL;
+    }
+    char *text = (char *) (argv + cmd->argc + 1);
+    for (int i = 0; i < cmd->argc; i++) {
+        argv[i] = strcpy(text, cmd->argv[i]);
+        text += strlen(text) + 1;
+    }
+    argv[cmd->argc] = NULL;
+    *stage = (builtinStage) { .argv = argv, .argc = cmd->argc, .inFD = inFD, .outFD = outFD,
+                              .fanOut = fanOut, .numOfFanOut = numOfFanOut };
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, builtinThread, stage);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        free(argv);
+        free(stage);
+        return NULL;
+    }
+    return stage;
+}
 
 
+// job table. Every pipeline the shell starts, foreground or background, is a
+// job. Children are reaped asynchronously by the SIGCHLD handler, which only
+// updates the table; the main loop blocks SIGCHLD whenever it touches the table
+// and reports finished background jobs before each prompt, so a finished job
+// never lingers as a zombie and reaping never holds up the prompt.
+#define MAX_JOBS 1024
+
+enum { PROC_RUNNING, PROC_STOPPED, PROC_DONE };
+
+typedef struct {
+    int id;                 // number shown to the user, 0 if the slot is free
+    pid_t pgid;
+    pid_t *pids;            // one process per stage
+    char *procState;        // PROC_* for each of them
+    int numOfProcs;
+    builtinStage **builtins;    // for in-process stages, NULL for processes
+    int alive;              // stages not yet finished
+    int builtinsAlive;      // of those, how many are in-process
+    int stopped;            // and how many are stopped processes
+    int lastStatus;         // wait status of the job, set once every stage is done
+    int *branchEnd;         // index of the last stage of each branch, -1 if it did not start
+    char **branchNames;     // fan-out only: first command of each branch
+    int numOfBranches;      // 1 unless the job fans out
+    int background;         // not being waited on by the main loop
+    pid_t helper;           // holds the process group for in-process stages, 0 if none
+    int cancelStatus;       // wait status of the process whose death cancelled the job
+    char *text;             // the command line, for jobs and notifications
+
+    // filled in for every job, reported only for 'time' jobs
+    struct timespec start;  // when the first stage was forked
+    struct timespec *end;   // when each stage was reaped
+    struct rusage *usage;   // and its resource usage from wait4
+    int *status;            // and its wait status
+    int timed;
+    char *timeLog;
+} job;
+
+static job jobs[MAX_JOBS];
+static sigset_t childMask;          // just SIGCHLD
+static int interactive;             // stdin is a terminal we do job control on
+
+static void blockChild(void) { sigprocmask(SIG_BLOCK, &childMask, NULL); }
+static void unblockChild(void) { sigprocmask(SIG_UNBLOCK, &childMask, NULL); }
+
+// status of a branch: that of its last stage, exit 1 if that never started
+static int branchStatus(job *jb, int branch) {
+    int last = jb->branchEnd[branch];
+    return last >= 0 ? jb->status[last] : 1 << 8;
+}
 
+// sets the job's status once all its stages are done: that of its last stage,
+// or for a fan-out the first branch that failed. The helper is no longer needed.
+static void settleJob(job *jb) {
+    if (jb->helper > 0) kill(jb->helper, SIGKILL);
+    jb->lastStatus = 0;
+    for (int b = 0; b < jb->numOfBranches; b++) {
+        int status = branchStatus(jb, b);
+        if (status != 0 || b == jb->numOfBranches - 1) {
+            jb->lastStatus = status;
+            break;
+        }
+    }
+}
 
-// obtains the tokens and number of tokens associated with a single command
-// also obtain the in and out file descriptors if successful, this function
-// will execute the function given, reading from inFD and writing to outFD
-// and won't return. If not, it will return 1. This function is also 
-// responsible for handling redirects and the handling of background processes
-int shellExecute(char *tokens[], int numOfTokens, int inFD, int outFD) {
-    pid_t pid;
-    int status; // status of the shell execute (if 1, success)
-    int background = 0; // Background flag
-    int inputRedirected = 0, outputRedirected = 0; // Redirection Fladgs
-
-    // Parse tokens
-    for (int i = 0; i < numOfTokens; i++) {
-        if (strcmp(tokens[i], "<") == 0) {
-            inputRedirected = 1;
-            inFD = open(tokens[i + 1], O_RDONLY);
-            if (inFD < 0) {
-                perror("Failed to open input file");
-                return -1;
+// tells the job's running in-process stages to stop, as the signal that
+// killed a process of the job would have stopped them; runs inside the signal
+// handler
+static void cancelJob(job *jb, int status) {
+    if (jb->builtinsAlive == 0) return;
+    if (jb->cancelStatus == 0) jb->cancelStatus = status;
+    for (int i = 0; i < jb->numOfProcs; i++) {
+        if (jb->builtins[i] && jb->procState[i] != PROC_DONE) {
+            __atomic_store_n(&jb->builtins[i]->cancelled, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// records a wait status in the table; runs inside the signal handler
+static void updateProcess(pid_t pid, int status, struct rusage *usage) {
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (jobs[j].id == 0) continue;
+        if (jobs[j].helper == pid) {
+            // the helper only ends by a signal to the group, or by settleJob
+            if (!WIFSTOPPED(status) && !WIFCONTINUED(status)) {
+                jobs[j].helper = 0;
+                if (jobs[j].alive > 0) cancelJob(&jobs[j], status);
             }
-            tokens[i] = NULL; // Remove char
-            i++; // Skip filename (it will be parsed later).
-        } else if (strcmp(tokens[i], ">") == 0) {
-            outputRedirected = 1;
-            outFD = open(tokens[i+1], O_WRONLY | O_CREAT | O_TRUNC, 0666);  
-            if (outFD < 0) {
-                perror("Failed to open output file");
-                return -1;
+            return;
+        }
+        for (int i = 0; i < jobs[j].numOfProcs; i++) {
+            if (jobs[j].pids[i] != pid) continue;
+
+            char *state = &jobs[j].procState[i];
+            if (WIFSTOPPED(status)) {
+                if (*state == PROC_RUNNING) jobs[j].stopped++;
+                *state = PROC_STOPPED;
+            }
+            else if (WIFCONTINUED(status)) {
+                if (*state == PROC_STOPPED) jobs[j].stopped--;
+                *state = PROC_RUNNING;
             }
-            tokens[i] = NULL; //Remove char
-            i++; // Skip filename (it will be parsed later).
-        } else if (strcmp(tokens[i], "&") == 0) {
-            background = 1;
-            tokens[i] = NULL; // Remove background symbol from command
+            else {
+                if (*state == PROC_STOPPED) jobs[j].stopped--;
+                *state = PROC_DONE;
+                jobs[j].alive--;
+                jobs[j].usage[i] = *usage;
+                jobs[j].status[i] = status;
+                clock_gettime(CLOCK_MONOTONIC, &jobs[j].end[i]);
+                // SIGPIPE is how a producer normally ends once its reader has
+                // enough, as in `yes | head`; any other signal was for the job
+                if (WIFSIGNALED(status) && WTERMSIG(status) != SIGPIPE) cancelJob(&jobs[j], status);
+                if (jobs[j].alive == 0) settleJob(&jobs[j]);
+            }
+            return;
+        }
+    }
+}
+
+static void sigchldHandler(int sig) {
+    int savedErrno = errno, status;
+    struct rusage usage;
+    pid_t pid;
+    (void) sig;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        updateProcess(pid, status, &usage);
+    }
+
+    // in-process stages that have finished since the last signal
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (jobs[j].id == 0 || jobs[j].builtinsAlive == 0) continue;
+        for (int i = 0; i < jobs[j].numOfProcs; i++) {
+            builtinStage *stage = jobs[j].builtins[i];
+            if (!stage || jobs[j].procState[i] == PROC_DONE) continue;
+            if (!__atomic_load_n(&stage->finished, __ATOMIC_ACQUIRE)) continue;
+            jobs[j].procState[i] = PROC_DONE;
+            jobs[j].alive--;
+            jobs[j].builtinsAlive--;
+            int cancelled = __atomic_load_n(&stage->cancelled, __ATOMIC_RELAXED);
+            jobs[j].status[i] = cancelled ? jobs[j].cancelStatus : stage->status << 8;
+            jobs[j].usage[i] = stage->usage;
+            jobs[j].end[i] = stage->end;
+            if (jobs[j].alive == 0) settleJob(&jobs[j]);
+        }
+    }
+    errno = savedErrno;
+}
+
+// a job is stopped once all its processes are; in-process stages never stop
+static int jobStopped(job *jb) {
+    return jb->stopped > 0 && jb->stopped == jb->alive - jb->builtinsAlive;
+}
+
+// puts the shell's signal handling in place; called once from main
+void initJobControl(void) {
+    struct sigaction sa;
+
+    sigemptyset(&childMask);
+    sigaddset(&childMask, SIGCHLD);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchldHandler;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    // with a terminal, ^C and ^Z are for the foreground job, not the shell
+    interactive = isatty(STDIN_FILENO);
+    if (interactive) {
+        signal(SIGINT, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+    }
+    // an in-process stage writing to a closed pipe gets EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
+}
+
+// called in a child before exec to undo initJobControl
+static void resetSignals(void) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    unblockChild();
+}
+
+// claims a free slot for a pipeline of numOfProcs stages in numOfBranches
+// branches; SIGCHLD must be blocked
+static job *addJob(int numOfProcs, int numOfBranches, const char *text, int background) {
+    int id = 1;
+    job *slot = NULL;
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (jobs[j].id == 0) {
+            if (!slot) slot = &jobs[j];
+        }
+        else if (jobs[j].id >= id) {
+            id = jobs[j].id + 1;
+        }
+    }
+    if (!slot) {
+        fprintf(stderr, "too many jobs\n");
+        return NULL;
+    }
+    *slot = (job) { .id = id, .background = background, .numOfBranches = numOfBranches };
+    slot->branchEnd = malloc(numOfBranches * sizeof(int));
+    slot->branchNames = calloc(numOfBranches, sizeof(char *));
+    slot->pids = malloc(numOfProcs * sizeof(pid_t));
+    slot->procState = malloc(numOfProcs);
+    slot->builtins = calloc(numOfProcs, sizeof(builtinStage *));
+    slot->end = malloc(numOfProcs * sizeof(struct timespec));
+    slot->usage = malloc(numOfProcs * sizeof(struct rusage));
+    slot->status = malloc(numOfProcs * sizeof(int));
+    slot->text = strdup(text);
+    clock_gettime(CLOCK_MONOTONIC, &slot->start);
+    if (!slot->pids || !slot->procState || !slot->builtins || !slot->branchEnd || !slot->branchNames || !slot->end || !slot->usage || !slot->status || !slot->text) {
+        fprintf(stderr, "addJob: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    return slot;
+}
+
+static void freeJob(job *jb) {
+    free(jb->pids);
+    free(jb->procState);
+    for (int i = 0; i < jb->numOfProcs; i++) {
+        if (jb->builtins[i]) {
+            free(jb->builtins[i]->argv);
+            free(jb->builtins[i]->fanOut);
+            free(jb->builtins[i]);
+        }
+    }
+    free(jb->builtins);
+    for (int b = 0; b < jb->numOfBranches; b++) free(jb->branchNames[b]);
+    free(jb->branchNames);
+    free(jb->branchEnd);
+    free(jb->end);
+    free(jb->usage);
+    free(jb->status);
+    free(jb->text);
+    free(jb->timeLog);
+    jb->id = 0;
+}
+
+// shell-style status of a finished job: the exit code, or 128 + signal
+static int exitCode(int status) {
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
+
+static double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double elapsed(struct timespec from, struct timespec to) {
+    return (to.tv_sec - from.tv_sec) + (to.tv_nsec - from.tv_nsec) / 1e9;
+}
+
+// ru_maxrss is in kilobytes on Linux but in bytes on macOS
+static long maxrssKB(struct rusage *usage) {
+#ifdef __APPLE__
+    return usage->ru_maxrss / 1024;
+#else
+    return usage->ru_maxrss;
+#endif
+}
+
+// writes s as a JSON string literal
+static void jsonString(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(out, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20) fprintf(out, "\\u%04x", *s);
+        else fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+// the report of the 'time' builtin: wall, user and sys time, max RSS and
+// voluntary/involuntary context switches for every stage of the pipeline and
+// in total, on stderr, and as one JSON line appended to the -o log if given.
+// Wall time of a stage runs from the start of the pipeline to its exit.
+static void reportTimes(job *jb) {
+    double totalUser = 0, totalSys = 0, wall = 0;
+    long totalRss = 0, totalVcsw = 0, totalIvcsw = 0;
+    FILE *log = NULL;
+
+    if (jb->timeLog) {
+        log = fopen(jb->timeLog, "a");
+        if (!log) perror("time: cannot open log");
+    }
+    if (log) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        fprintf(log, "{\"time\":%lld.%03ld,\"command\":", (long long) now.tv_sec, now.tv_nsec / 1000000);
+        jsonString(log, jb->text);
+        fprintf(log, ",\"stages\":[");
+    }
+
+    fprintf(stderr, "%5s %10s %10s %10s %12s %8s %8s %7s\n", "stage", "wall", "user", "sys", "maxrss(KB)", "vcsw", "ivcsw", "status");
+    for (int i = 0; i < jb->numOfProcs; i++) {
+        struct rusage *ru = &jb->usage[i];
+        double stageWall = elapsed(jb->start, jb->end[i]);
+        int code = exitCode(jb->status[i]);
+
+        fprintf(stderr, "%5d %10.3f %10.3f %10.3f %12ld %8ld %8ld %7d\n", i + 1, stageWall,
+                seconds(ru->ru_utime), seconds(ru->ru_stime), maxrssKB(ru), ru->ru_nvcsw, ru->ru_nivcsw, code);
+        if (log) {
+            fprintf(log, "%s{\"stage\":%d,\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,\"status\":%d}",
+                    i ? "," : "", i + 1, stageWall, seconds(ru->ru_utime), seconds(ru->ru_stime), maxrssKB(ru), ru->ru_nvcsw, ru->ru_nivcsw, code);
         }
+
+        if (stageWall > wall) wall = stageWall;
+        totalUser += seconds(ru->ru_utime);
+        totalSys += seconds(ru->ru_stime);
+        if (maxrssKB(ru) > totalRss) totalRss = maxrssKB(ru);
+        totalVcsw += ru->ru_nvcsw;
+        totalIvcsw += ru->ru_nivcsw;
+    }
+    // the total's RSS is the largest stage, not a sum: stages are separate processes
+    fprintf(stderr, "%5s %10.3f %10.3f %10.3f %12ld %8ld %8ld %7d\n", "total", wall, totalUser, totalSys,
+            totalRss, totalVcsw, totalIvcsw, exitCode(jb->lastStatus));
+    if (log) {
+        fprintf(log, "],\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,\"status\":%d}\n",
+                wall, totalUser, totalSys, totalRss, totalVcsw, totalIvcsw, exitCode(jb->lastStatus));
+        fclose(log);
+    }
+}
+
+// forgets a job that has finished, after printing its times if it was timed
+// and the status of each branch if it fanned out
+static void finishJob(job *jb) {
+    if (jb->timed) reportTimes(jb);
+    for (int b = 0; jb->numOfBranches > 1 && b < jb->numOfBranches; b++) {
+        int status = branchStatus(jb, b);
+        if (WIFSIGNALED(status)) fprintf(stderr, "branch %d (%s): killed by signal %d\n", b + 1, jb->branchNames[b], WTERMSIG(status));
+        else fprintf(stderr, "branch %d (%s): exit %d\n", b + 1, jb->branchNames[b], WEXITSTATUS(status));
+    }
+    freeJob(jb);
+}
+
+// the job named by a jobs/fg/bg/wait argument ("2" or "%2"), or the most
+// recent job when there is no argument; SIGCHLD must be blocked
+static job *findJob(const char *arg) {
+    job *best = NULL;
+    int id = 0;
+    if (arg) {
+        if (*arg == '%') arg++;
+        id = atoi(arg);
+    }
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (jobs[j].id == 0) continue;
+        if (id ? jobs[j].id == id : (!best || jobs[j].id > best->id)) best = &jobs[j];
+    }
+    if (!best) fprintf(stderr, "%s: no such job\n", arg ? arg : "current");
+    return best;
+}
+
+// "Running", "Stopped", "Done", "Exit 3" or "Killed (9)"
+static const char *jobState(job *jb, char *buf, size_t size) {
+    if (jb->alive > 0) return jobStopped(jb) ? "Stopped" : "Running";
+    if (WIFSIGNALED(jb->lastStatus)) snprintf(buf, size, "Killed (%d)", WTERMSIG(jb->lastStatus));
+    else if (WEXITSTATUS(jb->lastStatus) != 0) snprintf(buf, size, "Exit %d", WEXITSTATUS(jb->lastStatus));
+    else return "Done";
+    return buf;
+}
+
+// prints and forgets background jobs that have finished since the last prompt
+void reportJobs(void) {
+    char buf[32];
+    blockChild();
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (jobs[j].id == 0 || jobs[j].alive > 0 || !jobs[j].background) continue;
+        printf("[%d]  %-12s %s\n", jobs[j].id, jobState(&jobs[j], buf, sizeof(buf)), jobs[j].text);
+        finishJob(&jobs[j]);
+    }
+    unblockChild();
+}
+
+// the 'jobs' builtin
+void listJobs(void) {
+    char buf[32];
+    blockChild();
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (jobs[j].id == 0) continue;
+        printf("[%d]  %-12s %s\n", jobs[j].id, jobState(&jobs[j], buf, sizeof(buf)), jobs[j].text);
+        if (jobs[j].alive == 0) finishJob(&jobs[j]);
+    }
+    unblockChild();
+}
+
+// waits in the foreground until the job exits or stops, with the terminal
+// handed to it. A job that stops stays in the table as a background job; one
+// that finishes is removed. Returns its exit code. SIGCHLD must be blocked.
+static int waitForeground(job *jb) {
+    sigset_t waitMask;
+    sigprocmask(SIG_SETMASK, NULL, &waitMask);
+    sigdelset(&waitMask, SIGCHLD);
+
+    jb->background = 0;
+    if (interactive && jb->pgid > 0) tcsetpgrp(STDIN_FILENO, jb->pgid);
+    while (jb->alive > 0 && !jobStopped(jb)) {
+        sigsuspend(&waitMask);
+    }
+    if (interactive) tcsetpgrp(STDIN_FILENO, getpgrp());
+
+    if (jb->alive > 0) {
+        jb->background = 1;
+        printf("\n[%d]  Stopped      %s\n", jb->id, jb->text);
+        return 128 + SIGTSTP;
+    }
+    int status = jb->lastStatus;
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "terminated by signal %d\n", WTERMSIG(status));
+    }
+    finishJob(jb);
+    return exitCode(status);
+}
+
+// sends SIGCONT to a stopped job and counts its processes as running again
+static void continueJob(job *jb) {
+    for (int i = 0; i < jb->numOfProcs; i++) {
+        if (jb->procState[i] == PROC_STOPPED) jb->procState[i] = PROC_RUNNING;
+    }
+    jb->stopped = 0;
+    if (jb->pgid > 0) kill(-jb->pgid, SIGCONT);
+}
+
+// fg [id] and bg [id]
+int resumeJob(const char *arg, int foreground) {
+    int status = 0;
+    blockChild();
+    job *jb = findJob(arg);
+    if (!jb) {
+        unblockChild();
+        return 1;
+    }
+    printf("%s\n", jb->text);
+    continueJob(jb);
+    if (foreground) status = waitForeground(jb);
+    else jb->background = 1;
+    unblockChild();
+    return status;
+}
+
+// wait [id]: waits for one job, or for every job when no id is given; stopped
+// jobs are not waited for. Returns the exit code of the (last) job.
+int waitJobs(const char *arg) {
+    sigset_t waitMask;
+    int status = 0;
+
+    blockChild();
+    sigprocmask(SIG_SETMASK, NULL, &waitMask);
+    sigdelset(&waitMask, SIGCHLD);
+    for (int j = 0; j < MAX_JOBS; j++) {
+        job *jb = &jobs[j];
+        if (arg) {
+            jb = findJob(arg);
+            if (!jb) {
+                status = 127;
+                break;
+            }
+        }
+        else if (jb->id == 0) {
+            continue;
+        }
+        while (jb->alive > 0 && !jobStopped(jb)) {
+            sigsuspend(&waitMask);
+        }
+        if (jb->alive == 0) {
+            status = exitCode(jb->lastStatus);
+            finishJob(jb);
+        }
+        if (arg) break;
+    }
+    unblockChild();
+    return status;
+}
+
+
+// obtains a single parsed command and the in and out file descriptors, opens
+// its '<' / '>' redirects and forks it, reading from inFD and writing to outFD.
+// The child joins process group pgid, or starts its own group when pgid is 0,
+// so that all the stages of one pipeline share a group. This function does not
+// wait for the child: it returns its pid, or -1 if it could not be started.
+// A cat/head/tee/wc stage may instead be started in-process: then 0 is
+// returned and *builtin is set.
+pid_t shellExecute(command *cmd, int inFD, int outFD, pid_t pgid, builtinStage **builtin) {
+    pid_t pid;
+    int inProcess = isBuiltinStage(cmd, inFD);
+
+    if (cmd->inFile) {
+        if (inFD != STDIN_FILENO) close(inFD);
+        inFD = open(cmd->inFile, O_RDONLY | O_CLOEXEC);
+        if (inFD < 0) {
+            perror("Failed to open input file");
+            if (outFD != STDOUT_FILENO) close(outFD);
+            return -1;
+        }
+    }
+    if (cmd->outFile) {
+        if (outFD != STDOUT_FILENO) close(outFD);
+        outFD = open(cmd->outFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (outFD < 0) {
+            perror("Failed to open output file");
+            if (inFD != STDIN_FILENO) close(inFD);
+            return -1;
+        }
+    }
+
+    if (inProcess && (*builtin = startBuiltin(cmd, inFD, outFD, NULL, 0)) != NULL) {
+        return 0;  // the stage's thread owns inFD and outFD now
     }
 
     pid = fork(); // Fork initiate
     if (pid == 0) { // Child process
-        // Redirect input
-        if (inFD != STDIN_FILENO) {
-            dup2(inFD, STDIN_FILENO);
-            close(inFD);
-        }
+        // Join the pipeline's group here as well as in the parent, so the group
+        // exists whichever of the two runs first
+        setpgid(0, pgid);
+        resetSignals();
+
+        // Redirect input. Every other descriptor the shell holds (pipe ends,
+        // redirect files) is close-on-exec, so no stage keeps a pipe open by
+        // accident and readers always see EOF.
+        if (inFD != STDIN_FILENO) dup2(inFD, STDIN_FILENO);
         // Redirect output
-        if (outFD != STDOUT_FILENO) {
-            dup2(outFD, STDOUT_FILENO);
-            close(outFD);
-        }
+        if (outFD != STDOUT_FILENO) dup2(outFD, STDOUT_FILENO);
 
-        // Close the read end of the pipe if it's not STDIN
-        if (inFD != 0) close(inFD);
-        // Close the write end of the pipe if it's not STDOUT
-        if (outFD != 1) close(outFD);
-        
-        if (execvp(tokens[0], tokens) == -1) {
+        if (execvp(cmd->argv[0], cmd->argv) == -1) {
             perror("Execvp Error: ");
-            exit(EXIT_FAILURE);
+            exit(127);
         }
     } else if (pid < 0) {
         //Fail check
         perror("Fork error");
-        return -1;
     } else {
-        // NOTE*: Parent process does not wait for background processes
-        if (!background) {
-            do {
-                waitpid(pid, &status, WUNTRACED);
-            } while (!WIFEXITED(status) && !WIFSIGNALED(status));
-        } else {
-            // Ensure the shell doesn't wait for this process:
-            setpgid(pid, pid); // Detach the process group of the background process.
+        setpgid(pid, pgid ? pgid : pid);
+    }
+
+    // Close in and out FD, the child has its own copies
+    if (inFD != STDIN_FILENO) close(inFD);
+    if (outFD != STDOUT_FILENO) close(outFD);
+
+    return pid;
+}
+
+
+// starts commands[first..last) as a chain of stages connected by pipes,
+// reading inFD and writing outFD, and adds them to the job. The stages join
+// process group *pgid, which is set by the first one forked. Returns the job's
+// index of the last stage, or -1 if it could not be started.
+static int startStages(job *jb, command *commands, int first, int last, int inFD, int outFD, pid_t *pgid) {
+    int lastIndex = -1;
+
+    for (int i = first; i < last; i++) {
+        int fd[2] = { STDIN_FILENO, outFD };
+        if (i < last - 1) { // Pipes = commands-1 (1 pipe for 2 commands, 2 for 3 etc..)
+            if (pipe(fd) != 0) {
+                // Fail check
+                perror("Pipe Failure");
+                if (inFD != STDIN_FILENO) close(inFD);
+                if (outFD != STDOUT_FILENO) close(outFD);
+                return -1;
+            }
+            fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+#ifdef F_SETPIPE_SZ
+            // larger pipes mean fewer wakeups and bigger splices per stage;
+            // this may fail above the system limit, which is harmless
+            fcntl(fd[1], F_SETPIPE_SZ, PIPE_SIZE);
+#endif
         }
 
-        // Close in and out FD
-        if (inFD != 0) close(inFD);
-        if (outFD != 1) close(outFD);
+        // shellExecute closes inFD and fd[1] once the stage owns them
+        builtinStage *builtin = NULL;
+        pid_t pid = shellExecute(&commands[i], inFD, fd[1], *pgid, &builtin);
+        lastIndex = -1;
+        if (pid >= 0) {
+            if (*pgid == 0) *pgid = pid;
+            lastIndex = jb->numOfProcs;
+            jb->pids[jb->numOfProcs] = pid;
+            jb->builtins[jb->numOfProcs] = builtin;
+            jb->procState[jb->numOfProcs++] = PROC_RUNNING;
+            jb->alive++;
+            if (builtin) jb->builtinsAlive++;
+        }
+        inFD = fd[0]; // Read from pipe.
     }
+    return lastIndex;
+}
 
-    return 1;
+// closes every descriptor from first up
+static void closeFrom(int first) {
+#ifdef CLOSE_RANGE_CLOEXEC
+    if (close_range(first, ~0U, 0) == 0) return;
+#endif
+    for (long fd = first, max = sysconf(_SC_OPEN_MAX); fd < max; fd++) close(fd);
 }
 
+// forks the helper of a job some of whose in-process stages could outlive all
+// its forked ones: it joins process group *pgid, or starts it when that is 0,
+// so signals for the job have a process to reach. It only waits to be killed,
+// by a signal to the group, which cancels the job's in-process stages, or by
+// settleJob once they are done. ^Z is ignored, as those stages cannot stop.
+static void startHelper(job *jb, pid_t *pgid) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, *pgid);
+        closeFrom(3);   // or it would hold the job's pipes open
+        resetSignals();
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+        for (;;) pause();
+    }
+    if (pid < 0) {
+        perror("Fork error");
+        return;
+    }
+    setpgid(pid, *pgid ? *pgid : pid);
+    if (*pgid == 0) *pgid = pid;
+    jb->helper = pid;
+}
+
+// a pipe whose ends are not inherited by exec'd stages
+static int shellPipe(int fd[2]) {
+    if (pipe(fd) != 0) {
+        perror("Pipe Failure");
+        return -1;
+    }
+    fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+#ifdef F_SETPIPE_SZ
+    fcntl(fd[1], F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+    return 0;
+}
+
+// forks every stage of a pipeline up front, connected by pipes and all in one
+// process group, so the stages run concurrently and a producer that writes more
+// than a pipe buffer is drained while it runs. For a fan-out the producer writes
+// into an in-process fan-out stage that feeds every branch. The pipeline becomes
+// a job; unless it ends with '&' it is given the terminal and waited on as a
+// whole. Returns the exit status of the last stage, or for a fan-out of the
+// first branch that failed (0 for a background pipeline).
+int runPipeline(commandLine *pipeline, const char *text) {
+    int numOfBranches = pipeline->numOfBranches;
+    pid_t pgid = 0;
+
+    // SIGCHLD stays blocked until every pid is in the table, so even a stage
+    // that exits at once is matched to its job
+    blockChild();
+    job *jb = addJob(pipeline->numOfCommands + (numOfBranches > 0), numOfBranches > 0 ? numOfBranches : 1,
+                     text, pipeline->background);
+    if (!jb) {
+        unblockChild();
+        return 1;
+    }
+    jb->timed = pipeline->timed;
+    if (pipeline->timeLog) jb->timeLog = strdup(pipeline->timeLog);
+
+    // a stage after a forked one ends when that gives it EOF, and one before
+    // it when it gets EPIPE, but a fan-out branch outlives its siblings: the
+    // helper is needed unless a stage ahead of the fan-out is forked
+    pid_t producerGroup = 0;
+    fflush(stdout); // or the children inherit and repeat buffered output
+    if (numOfBranches == 0) {
+        jb->branchEnd[0] = startStages(jb, pipeline->commands, 0, pipeline->numOfCommands,
+                                       STDIN_FILENO, STDOUT_FILENO, &pgid);
+        producerGroup = pgid;
+    }
+    else {
+        int fanIn[2] = { -1, -1 }, *outs = malloc(numOfBranches * sizeof(int));
+        int producer = -1, started = 0;
+        if (outs && shellPipe(fanIn) == 0) {
+            producer = startStages(jb, pipeline->commands, 0, pipeline->branchStart[0], STDIN_FILENO, fanIn[1], &pgid);
+            producerGroup = pgid;
+        }
+        for (int b = 0; b < numOfBranches; b++) {
+            int fd[2];
+            jb->branchNames[b] = strdup(pipeline->commands[pipeline->branchStart[b]].argv[0]);
+            jb->branchEnd[b] = -1;
+            if (producer < 0 || shellPipe(fd) != 0) continue;
+            outs[started++] = fd[1];
+            jb->branchEnd[b] = startStages(jb, pipeline->commands, pipeline->branchStart[b], pipeline->branchStart[b + 1],
+                                           fd[0], STDOUT_FILENO, &pgid);
+        }
+
+        command fanOut = { (char *[]) { "fan-out", NULL }, 1, NULL, NULL };
+        builtinStage *stage = NULL;
+        if (producer >= 0) stage = startBuiltin(&fanOut, fanIn[0], -1, outs, started);
+        if (stage) {
+            jb->pids[jb->numOfProcs] = 0;
+            jb->builtins[jb->numOfProcs] = stage;
+            jb->procState[jb->numOfProcs++] = PROC_RUNNING;
+            jb->alive++;
+            jb->builtinsAlive++;
+        }
+        else {
+            // without the fan-out stage the producer gets EPIPE and the branches EOF
+            if (fanIn[0] >= 0) close(fanIn[0]);
+            for (int i = 0; i < started; i++) close(outs[i]);
+            free(outs);
+        }
+    }
+    if (producerGroup == 0 && jb->builtinsAlive > 0) startHelper(jb, &pgid);
+    jb->pgid = pgid;
 
-int main(){
-    char *line = NULL;              // line read from terminal
+    int status = 0;
+    if (jb->numOfProcs == 0) {
+        freeJob(jb);
+        status = 1;
+    }
+    else if (pipeline->background) {
+        printf("[%d] %d\n", jb->id, pgid);
+    }
+    else {
+        status = waitForeground(jb);
+    }
+    unblockChild();
+    return status;
+}
+
+
+// times parseLine on machine-generated lines of the given size: one long
+// command of mixed plain, quoted and escaped words, and the same words split
+// into a pipeline. Used to check the lexer stays linear in the line length.
+int lexBenchmark(size_t bytes) {
+    static const char *pieces[] = { "word ", "\"two words\" ", "'it\\'s' ", "esc\\ aped ", "\"a|b\" ", "x<in ", "-flag " };
+    char *line = malloc(bytes + 64);
+    arena a = { NULL, 0 };
+    commandLine parsed;
+    unsigned seed = 1;
+
+    if (!line) {
+        fprintf(stderr, "lexBenchmark: allocation error\n");
+        return EXIT_FAILURE;
+    }
+    printf("%-10s %10s %10s %10s %10s\n", "shape", "bytes", "commands", "ms", "MB/s");
+    for (int pipes = 0; pipes <= 1; pipes++) {
+        size_t length = 0;
+        while (length < bytes) {
+            seed = seed * 1103515245 + 12345;
+            const char *piece = pipes && (seed >> 16) % 8 == 0 ? "| cmd " : pieces[(seed >> 16) % 7];
+            size_t n = strlen(piece);
+            memcpy(line + length, piece, n);
+            length += n;
+        }
+        line[length] = '\0';
+
+        double best = 1e30;
+        for (int run = 0; run < 5; run++) {
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (parseLine(line, length, &a, &parsed) != 0) return EXIT_FAILURE;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+            if (elapsed < best) best = elapsed;
+            arenaReset(&a);
+        }
+        printf("%-10s %10zu %10d %10.3f %10.1f\n", pipes ? "pipeline" : "one-cmd", length,
+               parsed.numOfCommands, best * 1e3, length / best / 1e6);
+    }
+    free(line);
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char *argv[]){
+    char *line = NULL;              // line read from terminal, reused for every line
+    size_t length;                  // its length
     /*NOTE: this line is not representitive of a concatenated argv since
     it may include symbols such as such as '|', '&', '<' or '>'*/
 
-    char **commandList = NULL;      // list of commands stored in a string array
-    int numOfCommands;              // number of commands in a single line
-    /*NOTE: a single entry within the commandList is not argv since that entry
-    may contain symbols such as '&', '<' or '>'*/
-
-    char **tokens = NULL;           // tokens associated with a single command
-    int numOfTokens;                // number of tokens associated with a single command
-    /*NOTE: these are not yet argv and argc since they may contain non argument tokens
-    such as '&', '<' or '>'.*/
+    arena lineArena = { NULL, 0 };  // holds everything parsed from the current line
+    commandLine parsed;             // the commands of the line, with redirects and '&' already applied
+    char **tokens = NULL;           // argv of a single command
 
     int status;                     // return status of an executed command
 
+    // ExtendedShell -B [MB]: benchmark the lexer instead of running a shell
+    if (argc >= 2 && strcmp(argv[1], "-B") == 0) {
+        return lexBenchmark((argc >= 3 ? atof(argv[2]) : 4) * 1e6);
+    }
+
+    initJobControl();
     while(1){
+        reportJobs();
         printf("\n>> ");
-        line = readLine();
-        commandList = splitLine(line, &numOfCommands);
+        fflush(stdout);     // the prompt has to show up even when stdout is a pipe
+        line = readLine(&length);
+        if(line == NULL){
+            printf("\n");
+            break;
+        }
+        if(parseLine(line, length, &lineArena, &parsed) != 0 || parsed.numOfCommands == 0){
+            arenaReset(&lineArena);
+            continue;
+        }
         
-        // if a single command is parsed, it means there are
-        // no pipes and we can just execute it normally
-        if(numOfCommands == 1){
-            tokens = parseCommand(line, &numOfTokens);
+        // time [-o logfile] pipeline: strip the prefix and flag the line; the
+        // report is printed when the job finishes
+        tokens = parsed.commands[0].argv;
+        if(strcmp(tokens[0], "time") == 0){
+            int skip = 1;
+            if(tokens[1] && strcmp(tokens[1], "-o") == 0 && tokens[2]){
+                parsed.timeLog = tokens[2];
+                skip = 3;
+            }
+            parsed.commands[0].argv += skip;
+            parsed.commands[0].argc -= skip;
+            parsed.timed = 1;
+            if(parsed.commands[0].argc == 0){
+                fprintf(stderr, "usage: time [-o logfile] command [| command ...]\n");
+                arenaReset(&lineArena);
+                continue;
+            }
+            status = runPipeline(&parsed, line);
+            arenaReset(&lineArena);
+            continue;
+        }
 
+        // if a single command is parsed, it means there are
+        // no pipes and it may be a shell builtin
+        if(parsed.numOfCommands == 1 && strcmp(tokens[0], "exit") == 0){
             // we check if the command given is a shell builtin
             // those have other APIs we can utilize without needing
             // to fork or do anything fancy
-            if(strcmp(tokens[0], "exit") == 0){
-                printf("Exiting...\n");
-                break;
+            printf("Exiting...\n");
+            break;
+        }
+        else if(parsed.numOfCommands == 1 && strcmp(tokens[0], "cd") == 0){
+            if (tokens[1] == NULL) {
+                fprintf(stderr, "cd: no path directory not specified\n");
             }
-            else if(strcmp(tokens[0], "cd") == 0){
-                if (tokens[1] == NULL) {
-                    fprintf(stderr, "cd: no path directory not specified\n");
-                }
-                else {
-                    if (chdir(tokens[1]) != 0) {
-                        fprintf(stderr, "cd: directory not found\n");
-                    }
+            else {
+                if (chdir(tokens[1]) != 0) {
+                    fprintf(stderr, "cd: directory not found\n");
                 }
             }
-            else if(strcmp(tokens[0], "help") == 0){
-                printf("SHELL HELP\n");
-                printf("These are the built-in commands:\n");
-                printf("    - help\n");
-                printf("    - cd <path>\n");
-                printf("    - exit\n");
-                printf("Type man <command> to know about a command\n");
-                printf("Type man to know about other commands\n");
-                status = 0;
-            }
-            
-            // if it's not a shell builtin, we execute it with standard 
-            // in and out file descriptors
-            else
-                status = shellExecute(tokens, numOfTokens, 0, 1);
         }
-        
-        // if we have multiple commands and one or more pipes
-        // then we have to construct and allocate the pipes
-        // such that we can establish interprocess communication (IPC) 
-        else if(numOfCommands > 1){
-            int inFD = 0; 
-            for (int i = 0; i < numOfCommands; i++) {
-                int fd[2];
-                if (i < numOfCommands - 1) { // Pipes = commands-1 (1 pipe for 2 commands, 2 for 3 etc..)
-                    if (pipe(fd) != 0) {
-                        // Fail check
-                        perror("Pipe Failure");
-                        exit(EXIT_FAILURE);
-                    }
-                }
-
-                char **tokens;
-                int numOfTokens;
-                tokens = parseCommand(commandList[i], &numOfTokens);
-
-                if (i == numOfCommands - 1) { // For the last command, output to stdout
-                    shellExecute(tokens, numOfTokens, inFD, STDOUT_FILENO);
-                } else {
-                    // For other commands, output to the pipe
-                    shellExecute(tokens, numOfTokens, inFD, fd[1]);
-                    close(fd[1]); // We do not need the input anymore, close.
-                }
-
-                if (inFD != STDIN_FILENO) {
-                    close(inFD); // Close the previous read of the pipe.
-                }
-                inFD = fd[0]; // Read from pipe.
-                // Free tokens just in case.
-                free(tokens);
-            }
+        else if(parsed.numOfCommands == 1 && strcmp(tokens[0], "jobs") == 0){
+            listJobs();
+            status = 0;
         }
-
-        // if you used dynamic mmeory allocation (which I highly recommend in this
-        // instance) this code will deallocate it
-        if(tokens){
-            free(tokens);
-            tokens = NULL;
+        else if(parsed.numOfCommands == 1 && strcmp(tokens[0], "wait") == 0){
+            status = waitJobs(tokens[1]);
         }
-        if(line){
-            free(line);
-            line = NULL;
+        else if(parsed.numOfCommands == 1 && (strcmp(tokens[0], "fg") == 0 || strcmp(tokens[0], "bg") == 0)){
+            status = resumeJob(tokens[1], tokens[0][0] == 'f');
         }
-        if(commandList){
-            free(commandList);
-            commandList = NULL;
+        else if(parsed.numOfCommands == 1 && strcmp(tokens[0], "help") == 0){
+            printf("SHELL HELP\n");
+            printf("These are the built-in commands:\n");
+            printf("    - help\n");
+            printf("    - cd <path>\n");
+            printf("    - jobs\n");
+            printf("    - wait [job]\n");
+            printf("    - fg [job]\n");
+            printf("    - bg [job]\n");
+            printf("    - time [-o logfile] <pipeline>\n");
+            printf("    - exit\n");
+            printf("Type man <command> to know about a command\n");
+            printf("Type man to know about other commands\n");
+            status = 0;
         }
+
+        // anything else is a pipeline, possibly of one command; every stage
+        // is forked before any is waited on, see runPipeline
+        else {
+            status = runPipeline(&parsed, line);
+        }
+
+        // everything parsed from the line lives in the arena
+        arenaReset(&lineArena);
     }
-    // IF for whatever reason we left the while loop earlier - make sure everything is fine 
-    if(tokens) free(tokens);
-    if(line) free(line);
-    if(commandList) free(commandList);
+    (void) status;
     return 0;
 }
 
@@ -512,6 +1812,9 @@ int main(){
     // ls | wc -l
     // ls | grep "file" | wc -l
     // ls | grep "file" > output.txt
+    // cat in.txt | tee out.txt | wc -l          (out.txt == in.txt)
+    // cat in.txt | tee -a out.txt | wc -l       (run twice: every line counted both times, out.txt doubles)
+    // cat big.txt big.txt big.txt | wc -l      (no stage forked; ^C and kill -TERM -<pgid> still stop it)
 
 
 // Redirection (<, >):
@@ -0,0 +1,330 @@
+#include "errno.h"
+#include "fcntl.h"
+#include "signal.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/stat.h"
+#include "sys/wait.h"
+#include "time.h"
+#include "unistd.h"
+
+// drives ExtendedShell non-interactively and measures it from the outside:
+//   - commands per second and latency for trivial commands
+//   - time to first byte and MB/s for pipelines of 1 to 16 stages, with the
+//     in-process cat and with /bin/cat
+//   - redirection throughput
+//   - the cases from the testing notes at the bottom of ExtendedShell.c,
+//     scaled up to a generated input file
+// Every case prints a percentile table, and with -o each case is also written
+// as one JSON line, so the results of two builds can be diffed. Before timing
+// anything, a few pipelines are checked for complete output, so a fast path
+// that drops data cannot pass for a fast one.
+//
+// usage: ShellBenchmark [-s shell] [-n commands] [-r runs] [-m MB] [-o results.jsonl]
+
+#define PROMPT "\n>> "
+#define PROMPT_LENGTH 4
+#define READ_SIZE 65536
+
+static const char *shellPath = "./shell";
+static int numOfCommands = 1000;    // repetitions of trivial commands
+static int numOfRuns = 5;           // repetitions of data-moving cases
+static int inputMB = 64;            // size of the generated input file
+static FILE *results = NULL;        // -o file, or NULL
+
+static pid_t shellPid;
+static int toShell = -1, fromShell = -1;
+static char inputFile[] = "/tmp/shellbenchXXXXXX";
+static char outputFile[64];
+static char teeFile[64];
+static long long inputSize, inputLines;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// starts the shell with its stdin and stdout on pipes and its stderr on
+// /dev/null; main then reads up to the first prompt
+static int startShell(void) {
+    int in[2], out[2];
+    if (pipe(in) != 0 || pipe(out) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    shellPid = fork();
+    if (shellPid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (shellPid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        if (devnull >= 0) dup2(devnull, STDERR_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        execl(shellPath, shellPath, (char *) NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    toShell = in[1];
+    fromShell = out[0];
+    return 0;
+}
+
+// sends one command line (nothing if line is NULL) and reads the shell's
+// output up to the next prompt.
+// *firstByte is set to the seconds until output other than the prompt
+// arrived (or the total when there was none) and *bytes to the amount of it.
+// Returns the seconds until the prompt, or -1 if the shell went away.
+static double runCommand(const char *line, double *firstByte, long long *bytes) {
+    static char *buf = NULL;
+    char tail[PROMPT_LENGTH] = { 0 };
+    long long total = 0;
+    double start = now(), first = -1;
+
+    if (!buf && !(buf = malloc(READ_SIZE))) return -1;
+    if (line) {
+        size_t length = strlen(line);
+        if (write(toShell, line, length) != (ssize_t) length || write(toShell, "\n", 1) != 1) return -1;
+    }
+
+    while (1) {
+        ssize_t n = read(fromShell, buf, READ_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        if (first < 0) first = now();
+        total += n;
+
+        // keep the last PROMPT_LENGTH bytes of the stream to spot the prompt
+        if (n >= PROMPT_LENGTH) {
+            memcpy(tail, buf + n - PROMPT_LENGTH, PROMPT_LENGTH);
+        }
+        else {
+            memmove(tail, tail + n, PROMPT_LENGTH - n);
+            memcpy(tail + PROMPT_LENGTH - n, buf, n);
+        }
+        if (total >= PROMPT_LENGTH && memcmp(tail, PROMPT, PROMPT_LENGTH) == 0) break;
+    }
+
+    double end = now();
+    total -= PROMPT_LENGTH;
+    if (firstByte) *firstByte = (total > 0 ? first : end) - start;
+    if (bytes) *bytes = total;
+    return end - start;
+}
+
+// prints one table row and, with -o, the matching JSON line. samples are
+// seconds; mbps is left out when it is negative.
+static void report(const char *name, const char *metric, double *samples, int n, double mbps) {
+    qsort(samples, n, sizeof(double), compareDouble);
+    double p50 = samples[n / 2] * 1e3, p90 = samples[n * 9 / 10] * 1e3;
+    double p99 = samples[n * 99 / 100] * 1e3, max = samples[n - 1] * 1e3;
+
+    printf("%-34s %-6s %9.3f %9.3f %9.3f %9.3f", name, metric, p50, p90, p99, max);
+    if (mbps >= 0) printf(" %9.1f", mbps);
+    printf("\n");
+    if (results) {
+        fprintf(results, "{\"case\":\"%s\",\"metric\":\"%s\",\"runs\":%d,\"p50_ms\":%.4f,\"p90_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f",
+                name, metric, n, p50, p90, p99, max);
+        if (mbps >= 0) fprintf(results, ",\"mb_per_s\":%.2f", mbps);
+        fprintf(results, "}\n");
+    }
+}
+
+// a command repeated numOfCommands times: latency per command and commands per second
+static int benchTrivial(const char *name, const char *line) {
+    double *samples = malloc(numOfCommands * sizeof(double));
+    double start = now();
+    if (!samples) return -1;
+    for (int i = 0; i < numOfCommands; i++) {
+        if ((samples[i] = runCommand(line, NULL, NULL)) < 0) {
+            free(samples);
+            return -1;
+        }
+    }
+    double elapsed = now() - start;
+    report(name, "total", samples, numOfCommands, -1);
+    printf("%-34s %.0f commands/s\n", "", numOfCommands / elapsed);
+    if (results) fprintf(results, "{\"case\":\"%s\",\"metric\":\"commands_per_s\",\"value\":%.1f}\n", name, numOfCommands / elapsed);
+    free(samples);
+    return 0;
+}
+
+// a data-moving command run numOfRuns times: time to first byte, total time,
+// and MB/s of megabytes (the input size unless the command's output is bigger)
+static int benchData(const char *name, const char *line) {
+    double *firstByte = malloc(numOfRuns * sizeof(double));
+    double *total = malloc(numOfRuns * sizeof(double));
+    long long bytes = 0;
+    if (!firstByte || !total) return -1;
+
+    for (int i = 0; i < numOfRuns; i++) {
+        if ((total[i] = runCommand(line, &firstByte[i], &bytes)) < 0) {
+            free(firstByte);
+            free(total);
+            return -1;
+        }
+    }
+    report(name, "ttfb", firstByte, numOfRuns, -1);
+    double moved = bytes > inputSize ? bytes : inputSize;
+    qsort(total, numOfRuns, sizeof(double), compareDouble);
+    report(name, "total", total, numOfRuns, moved / total[numOfRuns / 2] / 1e6);
+    free(firstByte);
+    free(total);
+    return 0;
+}
+
+// numbers, one per line, in a random order so sort has work to do
+static int makeInput(void) {
+    int fd = mkstemp(inputFile);
+    if (fd < 0) {
+        perror("mkstemp");
+        return -1;
+    }
+    FILE *f = fdopen(fd, "w");
+    unsigned long long seed = 88172645463325252ULL;
+    inputSize = 0;
+    while (inputSize < (long long) inputMB * 1000000) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        inputSize += fprintf(f, "%llu\n", seed % 1000000000);
+        inputLines++;
+    }
+    fclose(f);
+    snprintf(outputFile, sizeof(outputFile), "%s.out", inputFile);
+    snprintf(teeFile, sizeof(teeFile), "%s.tee", inputFile);
+    return 0;
+}
+
+static long long fileSize(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long) st.st_size : -1;
+}
+
+// runs line, which must write a line count to outputFile, and checks the
+// count and that the file tee writes to has grown to teeSize bytes
+static int checkTee(const char *name, const char *line, long long teeSize) {
+    long long lines = -1;
+    FILE *f;
+    if (runCommand(line, NULL, NULL) < 0) return -1;
+    if ((f = fopen(outputFile, "r"))) {
+        if (fscanf(f, "%lld", &lines) != 1) lines = -1;
+        fclose(f);
+    }
+    int ok = lines == inputLines && fileSize(teeFile) == teeSize;
+    printf("check %-28s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) printf("      wc -l said %lld of %lld lines, %s has %lld of %lld bytes\n",
+                    lines, inputLines, teeFile, fileSize(teeFile), teeSize);
+    if (results) fprintf(results, "{\"case\":\"%s\",\"metric\":\"check\",\"ok\":%s}\n", name, ok ? "true" : "false");
+    return ok ? 0 : 1;
+}
+
+// the in-process tee must pass every byte both on and into its file
+static int runChecks(void) {
+    char line[1024];
+    int failed = 0;
+
+    unlink(teeFile);
+    snprintf(line, sizeof(line), "cat %s | tee %s | wc -l > %s", inputFile, teeFile, outputFile);
+    failed |= checkTee("cat in | tee f | wc -l", line, inputSize);
+    snprintf(line, sizeof(line), "cat %s | tee -a %s | wc -l > %s", inputFile, teeFile, outputFile);
+    failed |= checkTee("cat in | tee -a f | wc -l", line, 2 * inputSize);
+    failed |= checkTee("cat in | tee -a f | wc -l (again)", line, 3 * inputSize);
+    unlink(teeFile);
+    printf("\n");
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    char line[1024];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) shellPath = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) numOfCommands = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) numOfRuns = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) inputMB = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            results = fopen(argv[++i], "w");
+            if (!results) {
+                perror(argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else {
+            fprintf(stderr, "usage: %s [-s shell] [-n commands] [-r runs] [-m MB] [-o results.jsonl]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (numOfCommands < 1 || numOfRuns < 1 || inputMB < 1) {
+        fprintf(stderr, "%s: -n, -r and -m must be positive\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    if (makeInput() != 0 || startShell() != 0) return EXIT_FAILURE;
+    if (runCommand(NULL, NULL, NULL) < 0) {
+        fprintf(stderr, "%s: %s did not start\n", argv[0], shellPath);
+        unlink(inputFile);
+        return EXIT_FAILURE;
+    }
+
+    printf("shell %s, input %.1f MB, %d commands, %d runs\n\n", shellPath, inputSize / 1e6, numOfCommands, numOfRuns);
+    int failed = runChecks();
+    printf("%-34s %-6s %9s %9s %9s %9s %9s\n", "case", "metric", "p50 ms", "p90 ms", "p99 ms", "max ms", "MB/s");
+
+    failed |= benchTrivial("trivial: true", "true");
+    failed |= benchTrivial("trivial: builtin cd .", "cd .");
+    failed |= benchTrivial("trivial: echo hi > file", "echo hi > /dev/null");
+
+    // pipelines of cat stages, once with the in-process cat and once with /bin/cat
+    for (int external = 0; external <= 1 && !failed; external++) {
+        for (int stages = 1; stages <= 16 && !failed; stages *= 2) {
+            const char *cat = external ? "/bin/cat" : "cat";
+            char name[64];
+            int length = snprintf(line, sizeof(line), "%s %s", cat, inputFile);
+            for (int i = 1; i < stages; i++) length += snprintf(line + length, sizeof(line) - length, " | %s", cat);
+            snprintf(name, sizeof(name), "pipeline %2d x %s", stages, cat);
+            failed |= benchData(name, line);
+        }
+    }
+
+    // redirection
+    snprintf(line, sizeof(line), "cat < %s > %s", inputFile, outputFile);
+    failed |= benchData("redirect: cat < in > out", line);
+    snprintf(line, sizeof(line), "/bin/cat < %s > %s", inputFile, outputFile);
+    failed |= benchData("redirect: /bin/cat < in > out", line);
+
+    // the testing notes in ExtendedShell.c, on the generated input
+    snprintf(line, sizeof(line), "cat %s | wc > %s", inputFile, outputFile);
+    failed |= benchData("notes: cat in | wc > out", line);
+    snprintf(line, sizeof(line), "wc < %s | cat | cat > %s", inputFile, outputFile);
+    failed |= benchData("notes: wc < in | cat | cat > out", line);
+    snprintf(line, sizeof(line), "cat %s | grep 7 | wc -l", inputFile);
+    failed |= benchData("notes: cat in | grep 7 | wc -l", line);
+    snprintf(line, sizeof(line), "sort < %s > %s", inputFile, outputFile);
+    failed |= benchData("notes: sort < in > out", line);
+    snprintf(line, sizeof(line), "cat %s |& { wc -l ; grep -c 7 ; tail -1 }", inputFile);
+    failed |= benchData("fan-out: cat in |& { 3 branches }", line);
+
+    if (failed) fprintf(stderr, "%s: a check failed or the shell exited during the benchmark\n", argv[0]);
+
+    close(toShell);
+    waitpid(shellPid, NULL, 0);
+    unlink(inputFile);
+    unlink(outputFile);
+    if (results) fclose(results);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
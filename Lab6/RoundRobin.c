@@ -1,80 +1,128 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include "scheduler.h"
 
+// Ready queue of indices into the sorted process array. A process is queued
+// at most once at a time, so a ring of n slots never overflows.
 typedef struct {
-    int process_id;
-    int arrival_time;
-    int burst_time;
-    int remaining_time; // For tracking the remaining burst time
-    int completion_time;
-    int waiting_time;
-    int turnaround_time;
-} Process;
+    size_t *slots;
+    size_t capacity, head, size;
+} ReadyQueue;
 
-// Implementation of the bubble sort algorithm to sort the processes array by arrival time.
-// This ensures the scheduler considers processes in the order they arrive.
-void sortProcessesByArrival(Process processes[], int n) {
-    for (int i = 0; i < n - 1; i++) {
-        for (int j = 0; j < n - i - 1; j++) {
-            if (processes[j].arrival_time > processes[j + 1].arrival_time) {
-                // Swap processes[j] and processes[j + 1]
-                Process temp = processes[j];
-                processes[j] = processes[j + 1];
-                processes[j + 1] = temp;
-            }
-        }
-    }
+void enqueue(ReadyQueue *queue, size_t index) {
+    size_t tail = queue->head + queue->size++;
+    queue->slots[tail < queue->capacity ? tail : tail - queue->capacity] = index;
 }
 
-void calculateRoundRobinTimes(Process processes[], int n, int quantum) {
-    int total_time = 0;
-    for (int i = 0; i < n; i++) {
+size_t dequeue(ReadyQueue *queue) {
+    size_t index = queue->slots[queue->head];
+    queue->head = queue->head + 1 < queue->capacity ? queue->head + 1 : 0;
+    queue->size--;
+    return index;
+}
+
+// Round Robin with a FIFO ready queue. Processes that arrive during a time
+// slice (or a context switch) are queued before the process it preempts. When
+// nothing is ready the clock jumps to the next arrival, so the run takes
+// O(number of time slices) steps however far apart the arrivals are.
+// Switching the CPU from one process straight to another costs switch_cost
+// time units; switching from idle is free. Returns the number of switches.
+uint64_t calculateRoundRobinTimes(Process processes[], size_t n, int64_t quantum, int64_t switch_cost) {
+    ReadyQueue queue = { malloc((n ? n : 1) * sizeof(size_t)), n, 0, 0 };
+    size_t next = 0; // next process to arrive
+    long last = -1;  // process that last held the CPU, -1 after an idle period
+    int64_t current_time = 0;
+    uint64_t context_switches = 0;
+
+    if (queue.slots == NULL) {
+        fprintf(stderr, "cannot allocate a ready queue of %zu processes\n", n);
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < n; i++) {
         processes[i].remaining_time = processes[i].burst_time;
-        total_time += processes[i].burst_time;
     }
 
-    int current_time = 0, processed = 0;
-    while (total_time > 0) {
-        for (int i = 0; i < n; i++) {
-            if (processes[i].remaining_time > 0 && processes[i].arrival_time <= current_time) {
-                int time_slice = (processes[i].remaining_time > quantum) ? quantum : processes[i].remaining_time;
-                processes[i].remaining_time -= time_slice;
-                current_time += time_slice;
-                total_time -= time_slice;
+    while (next < n || queue.size > 0) {
+        if (queue.size == 0 && current_time < processes[next].arrival_time) {
+            current_time = processes[next].arrival_time; // The CPU is idle until the next arrival
+            last = -1;
+        }
+        while (next < n && processes[next].arrival_time <= current_time) {
+            enqueue(&queue, next++);
+        }
 
-                if (processes[i].remaining_time == 0) {
-                    processes[i].completion_time = current_time;
-                    processes[i].turnaround_time = processes[i].completion_time - processes[i].arrival_time;
-                    processes[i].waiting_time = processes[i].turnaround_time - processes[i].burst_time;
-                }
+        size_t i = dequeue(&queue);
+        if (last != -1 && (size_t) last != i) {
+            current_time += switch_cost;
+            context_switches++;
+            while (next < n && processes[next].arrival_time <= current_time) {
+                enqueue(&queue, next++);
             }
         }
+
+        int64_t time_slice = (processes[i].remaining_time > quantum) ? quantum : processes[i].remaining_time;
+        processes[i].remaining_time -= time_slice;
+        current_time += time_slice;
+        while (next < n && processes[next].arrival_time <= current_time) {
+            enqueue(&queue, next++);
+        }
+
+        if (processes[i].remaining_time == 0) {
+            processes[i].completion_time = current_time;
+        } else {
+            enqueue(&queue, i); // Back of the queue, behind the processes that arrived meanwhile
+        }
+        last = i;
     }
+    free(queue.slots);
+    return context_switches;
 }
 
-int main() {
-    Process processes[4] = {
+int main(int argc, char *argv[]) {
+    // Sample processes, used when no workload is given
+    Process sample[4] = {
         {1, 0, 8}, // Process ID, Arrival Time, Burst Time for Round Robin
         {2, 2, 5},
         {3, 4, 6},
         {4, 6, 7}
     };
+    Options options = { 0 };
+    Workload workload;
+    uint64_t quantum = 4;
+    uint64_t switch_cost = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int valid = 1;
+        if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            valid = parseCount("-q", argv[++i], INT64_MAX, &quantum);
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            valid = parseCount("-c", argv[++i], INT64_MAX, &switch_cost);
+        }
+        else {
+            valid = parseCommonOption(&options, argc, argv, &i);
+        }
+        if (!valid) {
+            printCommonUsage(argv[0], "[-q quantum] [-c switch_cost] ");
+            return 1;
+        }
+    }
+    if (quantum == 0) {
+        fprintf(stderr, "%s: the quantum must be positive\n", argv[0]);
+        return 1;
+    }
+    if (loadWorkload(&options, sample, 4, &workload) != 0) {
+        return 1;
+    }
 
-    int quantum = 4;
     // Sort processes by arrival time
-    sortProcessesByArrival(processes, 4);
+    sortProcessesByArrival(workload.processes, workload.count);
     // The Round Robin scheduling times for each process are calculated
-    calculateRoundRobinTimes(processes, 4, quantum);
+    uint64_t context_switches = calculateRoundRobinTimes(workload.processes, workload.count, quantum, switch_cost);
     // Output the results
-    printf("ProcessID\tArrival Time\tBurst Time\tWaiting Time\tTurnaround Time\tCompletion Time\n");
-    for (int i = 0; i < 4; i++) {
-        printf("%d\t\t%d\t\t%d\t\t%d\t\t%d\t\t%d\n",
-            processes[i].process_id,
-            processes[i].arrival_time,
-            processes[i].burst_time,
-            processes[i].waiting_time,
-            processes[i].turnaround_time,
-            processes[i].completion_time);
-    }
-
+    printResults(&options, workload.processes, workload.count);
+    printf("Context switches: %llu (%lld time units)\n",
+        (unsigned long long) context_switches, (long long) (context_switches * switch_cost));
+    freeWorkload(&workload);
     return 0;
 }
@@ -1,90 +1,61 @@
 #include <stdio.h>
-#include <limits.h>
+#include "scheduler.h"
 
-// Structure to represent a process
-typedef struct {
-    int process_id;       // Process ID
-    int arrival_time;     // Arrival time of the process
-    int burst_time;       // Burst time (execution time) of the process
-    int waiting_time;     // Waiting time of the process
-    int turnaround_time;  // Turnaround time of the process
-    int completion_time;  // Completion time of the process
-    int remaining_time;
-} Process;
+// Event-driven non-preemptive SJF. Arrived processes wait in a min-heap keyed
+// on burst time; the clock jumps from one completion to the next, or to the
+// next arrival when the CPU is idle, so the whole run is O(n log n).
+void calculateSJFNonPreemptiveTimes(Process processes[], size_t n) {
+    ReadyHeap ready;
+    size_t next = 0; // next process to arrive
+    int64_t currentTime = 0;
 
-// Implementation of the bubble sort algorithm to sort the processes array by arrival time.
-// This ensures the scheduler considers processes in the order they arrive.
-void sortProcessesByArrival(Process processes[], int n) {
-    for (int i = 0; i < n - 1; i++) {
-        for (int j = 0; j < n - i - 1; j++) {
-            if (processes[j].arrival_time > processes[j + 1].arrival_time) {
-                // Swap processes[j] and processes[j + 1]
-                Process temp = processes[j];
-                processes[j] = processes[j + 1];
-                processes[j + 1] = temp;
-            }
+    heapInit(&ready, n);
+    while (next < n || ready.size > 0) {
+        if (ready.size == 0 && currentTime < processes[next].arrival_time) {
+            currentTime = processes[next].arrival_time; // No process is ready, skip ahead to the next arrival
         }
-    }
-}
-
-// Scans the processes array to identify the most urgent executable process based on SJF criteria.
-int findNextProcess(Process processes[], int n, int currentTime) {
-    int minTime = INT_MAX, index = -1;
-    for (int i = 0; i < n; i++) {
-        if (processes[i].arrival_time <= currentTime && processes[i].remaining_time < minTime && processes[i].remaining_time > 0) {
-            minTime = processes[i].remaining_time;
-            index = i;
-        }
-    }
-    return index;
-}
-
-void calculateSJFNonPreemptiveTimes(Process processes[], int n) {
-    int total_time = 0, completed = 0, currentTime = 0;
-    // Initialize remaining times
-    for (int i = 0; i < n; i++) {
-        processes[i].remaining_time = processes[i].burst_time;
-        total_time += processes[i].burst_time;
-    }
-
-    while (completed != n) {
-        int index = findNextProcess(processes, n, currentTime);
-        if (index != -1) { // Process found to execute
-            currentTime += processes[index].burst_time;
-            processes[index].completion_time = currentTime;
-            processes[index].turnaround_time = processes[index].completion_time - processes[index].arrival_time;
-            processes[index].waiting_time = processes[index].turnaround_time - processes[index].burst_time;
-            processes[index].remaining_time = 0; // Mark as completed
-            completed++;
-        } else { // No process is ready to execute at the current time
-            currentTime++;
+        // Everything that has arrived by now joins the ready queue
+        while (next < n && processes[next].arrival_time <= currentTime) {
+            heapPush(&ready, processes[next].burst_time, next);
+            next++;
         }
+        // The shortest job runs to completion
+        Process *p = &processes[ready.entries[0].index];
+        heapPop(&ready);
+        currentTime += p->burst_time;
+        p->completion_time = currentTime;
+        p->remaining_time = 0; // Mark as completed
     }
+    heapFree(&ready);
 }
 
-int main() {
-    // Define sample processes
-    Process processes[4] = {
+int main(int argc, char *argv[]) {
+    // Define sample processes, used when no workload is given
+    Process sample[4] = {
         {1, 0, 6}, // Process ID, Arrival Time, Burst Time
         {2, 2, 3},
         {3, 4, 2},
         {4, 6, 8}
     };
+    Options options = { 0 };
+    Workload workload;
+
+    for (int i = 1; i < argc; i++) {
+        if (!parseCommonOption(&options, argc, argv, &i)) {
+            printCommonUsage(argv[0], "");
+            return 1;
+        }
+    }
+    if (loadWorkload(&options, sample, 4, &workload) != 0) {
+        return 1;
+    }
 
     // Sort processes by arrival time
-    sortProcessesByArrival(processes, 4);
+    sortProcessesByArrival(workload.processes, workload.count);
     // The SJF NonPreemptive scheduling times for each process are calculated
-    calculateSJFNonPreemptiveTimes(processes, 4);
+    calculateSJFNonPreemptiveTimes(workload.processes, workload.count);
     // Output the results
-    printf("ProcessID\tArrival Time\tBurst Time\tWaiting Time\tTurnaround Time\tCompletion Time\n");
-    for (int i = 0; i < 4; i++) {
-        printf("%d\t\t%d\t\t%d\t\t%d\t\t%d\t\t%d\n",
-            processes[i].process_id,
-            processes[i].arrival_time,
-            processes[i].burst_time,
-            processes[i].waiting_time,
-            processes[i].turnaround_time,
-            processes[i].completion_time);
-    }
+    printResults(&options, workload.processes, workload.count);
+    freeWorkload(&workload);
     return 0;
 }
@@ -1,93 +1,71 @@
 #include <stdio.h>
-#include <limits.h>
+#include "scheduler.h"
 
-// Structure to represent a process
-typedef struct {
-    int process_id;
-    int arrival_time;
-    int burst_time;
-    int remaining_time; // For tracking the remaining burst time
-    int completion_time;
-    int waiting_time;
-    int turnaround_time;
-    int started_at; // To track when the process started for the first time
-} Process;
+// Event-driven preemptive SJF (shortest remaining time first). The ready heap
+// is keyed on remaining time and its top is the running process. Running only
+// lowers the top's key, so the choice can change only when a process arrives:
+// the clock jumps to the next arrival or to the running process's completion,
+// whichever comes first, and the whole run is O(n log n).
+void calculateSJFPreemptiveTimes(Process processes[], size_t n) {
+    ReadyHeap ready;
+    size_t next = 0; // next process to arrive
+    int64_t currentTime = 0;
 
-// Implementation of the bubble sort algorithm to sort the processes array by arrival time.
-// This ensures the scheduler considers processes in the order they arrive.
-void sortProcessesByArrival(Process processes[], int n) {
-    for (int i = 0; i < n - 1; i++) {
-        for (int j = 0; j < n - i - 1; j++) {
-            if (processes[j].arrival_time > processes[j + 1].arrival_time) {
-                // Swap processes[j] and processes[j + 1]
-                Process temp = processes[j];
-                processes[j] = processes[j + 1];
-                processes[j + 1] = temp;
-            }
+    heapInit(&ready, n);
+    while (next < n || ready.size > 0) {
+        if (ready.size == 0 && currentTime < processes[next].arrival_time) {
+            currentTime = processes[next].arrival_time; // No process is ready, skip ahead to the next arrival
         }
-    }
-}
-
-// Scans the processes array to identify the most urgent executable process based on SJF criteria.
-int findNextProcess(Process processes[], int n, int currentTime) {
-    int minTime = INT_MAX, index = -1;
-    for (int i = 0; i < n; i++) {
-        if (processes[i].arrival_time <= currentTime && processes[i].remaining_time < minTime && processes[i].remaining_time > 0) {
-            minTime = processes[i].remaining_time;
-            index = i;
+        // Arrivals join the ready queue and preempt the running process if they are shorter
+        while (next < n && processes[next].arrival_time <= currentTime) {
+            heapPush(&ready, processes[next].remaining_time, next);
+            next++;
         }
-    }
-    return index;
-}
 
-void calculateSJFPreemptiveTimes(Process processes[], int n) {
-    int total_time = 0, completed = 0, currentTime = 0;
-    for (int i = 0; i < n; i++) {
-        processes[i].remaining_time = processes[i].burst_time;
-        total_time += processes[i].burst_time;
-        processes[i].started_at = -1; // Initialize with -1 indicating not started
-    }
-    while (completed != n) {
-        int index = findNextProcess(processes, n, currentTime);
-        if (index != -1) { // Process found to execute
-            if (processes[index].started_at == -1) {
-                processes[index].started_at = currentTime; // Mark start time if not started
-            }
-            processes[index].remaining_time--;
-            if (processes[index].remaining_time == 0) {
-                completed++;
-                processes[index].completion_time = currentTime + 1;
-                processes[index].turnaround_time = processes[index].completion_time - processes[index].arrival_time;
-                processes[index].waiting_time = processes[index].turnaround_time - processes[index].burst_time;
-            }
+        HeapEntry *running = &ready.entries[0];
+        int64_t finish = currentTime + running->key;
+        if (next < n && processes[next].arrival_time < finish) {
+            // Run until the next arrival, then reconsider
+            running->key -= processes[next].arrival_time - currentTime;
+            processes[running->index].remaining_time = running->key;
+            currentTime = processes[next].arrival_time;
+        } else {
+            currentTime = finish;
+            processes[running->index].remaining_time = 0;
+            processes[running->index].completion_time = currentTime;
+            heapPop(&ready);
         }
-        currentTime++;
     }
+    heapFree(&ready);
 }
 
-int main() {
-    // Define sample processes
-    Process processes[4] = {
+int main(int argc, char *argv[]) {
+    // Define sample processes, used when no workload is given
+    Process sample[4] = {
         {1, 0, 6}, // Process ID, Arrival Time, Burst Time
         {2, 2, 3},
         {3, 4, 2},
         {4, 6, 8}
     };
+    Options options = { 0 };
+    Workload workload;
+
+    for (int i = 1; i < argc; i++) {
+        if (!parseCommonOption(&options, argc, argv, &i)) {
+            printCommonUsage(argv[0], "");
+            return 1;
+        }
+    }
+    if (loadWorkload(&options, sample, 4, &workload) != 0) {
+        return 1;
+    }
 
     // Sort processes by arrival time
-    sortProcessesByArrival(processes, 4);
+    sortProcessesByArrival(workload.processes, workload.count);
     // The SJF Preemptive scheduling times for each process are calculated
-    calculateSJFPreemptiveTimes(processes, 4);
+    calculateSJFPreemptiveTimes(workload.processes, workload.count);
     // Output the results
-    printf("ProcessID\tArrival Time\tBurst Time\tWaiting Time\tTurnaround Time\tCompletion Time\n");
-    for (int i = 0; i < 4; i++) {
-        printf("%d\t\t%d\t\t%d\t\t%d\t\t%d\t\t%d\n",
-            processes[i].process_id,
-            processes[i].arrival_time,
-            processes[i].burst_time,
-            processes[i].waiting_time,
-            processes[i].turnaround_time,
-            processes[i].completion_time);
-    }
+    printResults(&options, workload.processes, workload.count);
+    freeWorkload(&workload);
     return 0;
 }
@@ -1,71 +1,315 @@
+#include <errno.h>
 #include <stdio.h>
+#include "scheduler.h"
+
+void calculateFCFSTimes(Process processes[], size_t n) {
+    int64_t service_time = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        // A process is served when the previous one completes, or when it arrives if the CPU was idle by then.
+        if (i == 0 || service_time < processes[i].arrival_time) {
+            service_time = processes[i].arrival_time;
+        }
+        processes[i].completion_time = service_time + processes[i].burst_time;// The completion time is the sum of its service time and burst time.
+        service_time = processes[i].completion_time;// The next process can be served once this one completes.
+    }
+}
+
+// Streaming mode (-t). A FCFS completion depends only on the one before it,
+// so each arrival is simulated as soon as it is read and only aggregate
+// statistics are kept. Memory use stays fixed however many processes there are.
+
+// HDR-style log-linear histogram. Values below 2 * HISTOGRAM_SUB are counted
+// exactly; larger values share HISTOGRAM_SUB buckets per power of two. A
+// reported percentile is therefore within 1/HISTOGRAM_SUB (0.8%) of the true value.
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB)
 
-// Structure to represent a process
 typedef struct {
-    int process_id;       // Process ID
-    int arrival_time;     // Arrival time of the process
-    int burst_time;       // Burst time (execution time) of the process
-    int waiting_time;     // Waiting time of the process
-    int turnaround_time;  // Turnaround time of the process
-    int completion_time;  // Completion time of the process
-    int service_time;     // Service time of the process
-} Process;
-
-// Implementation of the bubble sort algorithm to sort the processes array by arrival time.
-// This ensures the scheduler considers processes in the order they arrive.
-void sortProcessesByArrival(Process processes[], int n) {
-    for (int i = 0; i < n - 1; i++) {
-        for (int j = 0; j < n - i - 1; j++) {
-            if (processes[j].arrival_time > processes[j + 1].arrival_time) {
-                // Swap processes[j] and processes[j + 1]
-                Process temp = processes[j];
-                processes[j] = processes[j + 1];
-                processes[j + 1] = temp;
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    double sum;
+    int64_t max;
+} Histogram;
+
+static size_t histogramBucket(int64_t value) {
+    uint64_t v = value < 0 ? 0 : (uint64_t) value;
+    if (v < 2 * HISTOGRAM_SUB) return v;
+    int shift = 63 - __builtin_clzll(v) - HISTOGRAM_SUB_BITS;
+    return (size_t) shift * HISTOGRAM_SUB + (v >> shift);
+}
+
+// The largest value that falls into bucket
+static int64_t histogramValue(size_t bucket) {
+    if (bucket < 2 * HISTOGRAM_SUB) return bucket;
+    int shift = bucket / HISTOGRAM_SUB - 1;
+    uint64_t top = bucket - (uint64_t) shift * HISTOGRAM_SUB;
+    return (int64_t) (((top + 1) << shift) - 1);
+}
+
+static void histogramRecord(Histogram *h, int64_t value) {
+    h->counts[histogramBucket(value)]++;
+    h->total++;
+    h->sum += value;
+    if (value > h->max) h->max = value;
+}
+
+static int64_t histogramPercentile(const Histogram *h, double percentile) {
+    uint64_t rank = (uint64_t) (percentile / 100.0 * h->total + 0.5), seen = 0;
+    if (rank < 1) rank = 1;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            int64_t value = histogramValue(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+static void printHistogram(const char *name, const Histogram *h) {
+    printf("%-11s mean %.3f  p50 %lld  p90 %lld  p99 %lld  p999 %lld  max %lld\n", name,
+        h->total ? h->sum / h->total : 0.0,
+        (long long) histogramPercentile(h, 50), (long long) histogramPercentile(h, 90),
+        (long long) histogramPercentile(h, 99), (long long) histogramPercentile(h, 99.9),
+        (long long) h->max);
+}
+
+// Arrivals come from the -g generator or from a CSV or binary trace (a file or
+// stdin). Files are read through a fixed buffer rather than mapped, so pipes
+// work too.
+typedef struct {
+    const char *name;
+    int fd;
+    int binary;
+    int eof;
+    char buffer[1 << 20];
+    size_t start, end;         // unread bytes in buffer
+    size_t lineNumber, count;
+    Generator *generator;      // NULL unless -g
+    uint64_t remaining;        // processes left to generate, or trace records left to read
+} ArrivalStream;
+
+// Moves the unread bytes to the front of the buffer and reads more after them.
+// Returns 0 once the input is exhausted.
+static int fillStream(ArrivalStream *in) {
+    if (in->eof) return in->end > in->start;
+    memmove(in->buffer, in->buffer + in->start, in->end - in->start);
+    in->end -= in->start;
+    in->start = 0;
+    while (in->end < sizeof(in->buffer)) {
+        ssize_t n = read(in->fd, in->buffer + in->end, sizeof(in->buffer) - in->end);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror(in->name);
+            exit(EXIT_FAILURE);
+        }
+        if (n == 0) {
+            in->eof = 1;
+            break;
+        }
+        in->end += n;
+    }
+    return in->end > in->start;
+}
+
+static int openStream(ArrivalStream *in, const Options *options, Generator *generator) {
+    in->start = in->end = 0;
+    in->eof = in->binary = 0;
+    in->lineNumber = in->count = 0;
+    in->generator = NULL;
+    if (options->generate > 0) {
+        in->generator = generator;
+        in->remaining = options->generate;
+        initGenerator(generator, options->seed);
+        return 0;
+    }
+
+    in->name = options->input ? options->input : "stdin";
+    in->fd = options->input ? open(options->input, O_RDONLY) : STDIN_FILENO;
+    if (in->fd < 0) {
+        perror(in->name);
+        return -1;
+    }
+    posix_fadvise(in->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    fillStream(in);
+    if (in->end >= sizeof(TraceHeader) && memcmp(in->buffer, TRACE_MAGIC, 8) == 0) {
+        TraceHeader header;
+        memcpy(&header, in->buffer, sizeof(header));
+        in->binary = 1;
+        in->remaining = le64toh(header.count);
+        in->start = sizeof(TraceHeader);
+    }
+    return 0;
+}
+
+// Reads the next arrival into *p. Returns 1, 0 at the end, -1 on bad input.
+static int nextArrival(ArrivalStream *in, Process *p) {
+    if (in->generator != NULL) {
+        if (in->remaining == 0) return 0;
+        in->remaining--;
+        generateProcess(in->generator, p);
+        return 1;
+    }
+
+    if (in->binary) {
+        TraceRecord record;
+        if (in->remaining == 0) return 0;
+        if (in->end - in->start < sizeof(record)) fillStream(in);
+        if (in->end - in->start < sizeof(record)) {
+            fprintf(stderr, "%s: trace ends after %zu of its records\n", in->name, in->count);
+            return -1;
+        }
+        memcpy(&record, in->buffer + in->start, sizeof(record));
+        in->start += sizeof(record);
+        in->remaining--;
+        in->count++;
+        decodeRecord(&record, p);
+        return 1;
+    }
+
+    while (1) {
+        const char *line = in->buffer + in->start;
+        const char *eol = memchr(line, '\n', in->end - in->start);
+        if (eol == NULL) {
+            if (!in->eof) {
+                if (in->start == 0 && in->end == sizeof(in->buffer)) {
+                    fprintf(stderr, "%s:%zu: line too long\n", in->name, in->lineNumber + 1);
+                    return -1;
+                }
+                fillStream(in);
+                continue;
             }
+            if (in->start == in->end) return 0;
+            eol = in->buffer + in->end; // last line without a newline
         }
+        in->lineNumber++;
+        in->start = eol - in->buffer + (eol < in->buffer + in->end);
+
+        const char *s = line;
+        int64_t fields[3];
+        int numOfFields = 0;
+        while (s < eol && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+        if (s == eol || *s == '#') continue;
+        int field = 0;
+        while (numOfFields < 3 && (field = parseField(&s, eol, &fields[numOfFields])) > 0) numOfFields++;
+        if (field < 0) {
+            fprintf(stderr, "%s:%zu: number out of range\n", in->name, in->lineNumber);
+            return -1;
+        }
+        while (s < eol && (*s == ' ' || *s == '\t' || *s == ',' || *s == '\r')) s++;
+        if (numOfFields < 2 || s != eol) {
+            if (in->lineNumber == 1) continue; // header
+            fprintf(stderr, "%s:%zu: expected id,arrival,burst or arrival,burst\n", in->name, in->lineNumber);
+            return -1;
+        }
+        if (numOfFields == 3 && (fields[0] < INT32_MIN || fields[0] > INT32_MAX)) {
+            fprintf(stderr, "%s:%zu: process id %lld is out of range\n", in->name, in->lineNumber, (long long) fields[0]);
+            return -1;
+        }
+        in->count++;
+        p->process_id = numOfFields == 3 ? (int) fields[0] : (int) in->count;
+        p->arrival_time = fields[numOfFields - 2];
+        p->burst_time = fields[numOfFields - 1];
+        return 1;
     }
 }
-    
-void calculateFCFSTimes(Process processes[], int n) {
-    // Initial setup for the first process.
-    // The first process's service time is its arrival time, it has no waiting time,
-    // and its completion and turnaround times are calculated directly from its burst time.
-    processes[0].service_time = processes[0].arrival_time;
-    processes[0].waiting_time = 0;
-    processes[0].completion_time = processes[0].arrival_time + processes[0].burst_time;
-    processes[0].turnaround_time = processes[0].burst_time;
-
-    for (int i = 1; i < n; i++) {
-        processes[i].service_time = processes[i-1].completion_time;// For each subsequent process, calculate its service time based on the completion time of the previous process.
-        processes[i].waiting_time = processes[i].service_time - processes[i].arrival_time;// The waiting time is the difference between its service time and its arrival time.
-        processes[i].completion_time = processes[i].service_time + processes[i].burst_time;// The completion time is the sum of its service time and burst time.
-        processes[i].turnaround_time = processes[i].completion_time - processes[i].arrival_time;// The turnaround time is the difference between its completion time and arrival time.
+
+// Simulates FCFS over the stream and prints the statistics. The stream must
+// be in arrival order, which is the order FCFS serves it in.
+static int streamFCFS(const Options *options) {
+    static ArrivalStream in;
+    static Histogram waiting, turnaround;
+    Generator generator;
+    Process p;
+    int64_t service_time = 0, first_arrival = 0, last_arrival = 0;
+    double busy = 0;
+    int status;
+
+    if (openStream(&in, options, &generator) != 0) return -1;
+    while ((status = nextArrival(&in, &p)) == 1) {
+        if (p.burst_time <= 0 || p.arrival_time < 0) {
+            fprintf(stderr, "process %d: arrival time must be >= 0 and burst time > 0\n", p.process_id);
+            status = -1;
+            break;
+        }
+        if (waiting.total == 0) {
+            first_arrival = service_time = p.arrival_time;
+        }
+        else if (p.arrival_time < last_arrival) {
+            fprintf(stderr, "process %d: arrives at %lld, before the process ahead of it; -t needs the arrivals in order\n",
+                p.process_id, (long long) p.arrival_time);
+            status = -1;
+            break;
+        }
+        last_arrival = p.arrival_time;
+
+        if (service_time < p.arrival_time) {
+            service_time = p.arrival_time; // The CPU was idle
+        }
+        p.completion_time = service_time + p.burst_time;
+        service_time = p.completion_time;
+        busy += p.burst_time;
+        histogramRecord(&waiting, waitingTime(&p));
+        histogramRecord(&turnaround, turnaroundTime(&p));
     }
+    if (in.generator == NULL && options->input != NULL) close(in.fd);
+    if (status < 0) return -1;
+
+    // service_time is now the last completion
+    int64_t span = service_time - first_arrival;
+    printf("processes   %llu\n", (unsigned long long) waiting.total);
+    printHistogram("waiting", &waiting);
+    printHistogram("turnaround", &turnaround);
+    printf("throughput  %.6f processes per time unit\n", span > 0 ? waiting.total / (double) span : 0.0);
+    printf("cpu         %.2f%% busy between the first arrival and the last completion (%lld)\n",
+        span > 0 ? 100.0 * busy / span : 0.0, (long long) service_time);
+    return 0;
 }
 
-int main() {
-    // Define sample processes
-    Process processes[4] = {
+int main(int argc, char *argv[]) {
+    // Define sample processes, used when no workload is given
+    Process sample[4] = {
         {1, 0, 10}, // Process ID, Arrival Time, Burst Time
         {2, 2, 3},
         {3, 4, 7},
         {4, 6, 5}
     };
+    Options options = { 0 };
+    Workload workload;
+    int stream = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0) {
+            stream = 1;
+        }
+        else if (strcmp(argv[i], "-") == 0) {
+            stream = 1; // stream from stdin
+        }
+        else if (!parseCommonOption(&options, argc, argv, &i)) {
+            printCommonUsage(argv[0], "[-t] ");
+            return 1;
+        }
+    }
+    if (stream) {
+        // With -t the arrivals come from -g, the workload file or stdin, one at a time
+        if (options.output != NULL) {
+            fprintf(stderr, "%s: -o cannot be used with -t\n", argv[0]);
+            return 1;
+        }
+        return streamFCFS(&options) == 0 ? 0 : 1;
+    }
+    if (loadWorkload(&options, sample, 4, &workload) != 0) {
+        return 1;
+    }
 
     // Sort processes by arrival time
-    sortProcessesByArrival(processes, 4);
+    sortProcessesByArrival(workload.processes, workload.count);
     // The FCFS scheduling times for each process are calculated
-    calculateFCFSTimes(processes, 4);
+    calculateFCFSTimes(workload.processes, workload.count);
     // Output the results
-    printf("ProcessID\tArrival Time\tBurst Time\tWaiting Time\tTurnaround Time\tCompletion Time\n");
-    for (int i = 0; i < 4; i++) {
-        printf("%d\t\t%d\t\t%d\t\t%d\t\t%d\t\t%d\n",
-            processes[i].process_id,
-            processes[i].arrival_time,
-            processes[i].burst_time,
-            processes[i].waiting_time,
-            processes[i].turnaround_time,
-            processes[i].completion_time);
-    }
+    printResults(&options, workload.processes, workload.count);
+    freeWorkload(&workload);
     return 0;
 }
@@ -0,0 +1,518 @@
+// Shared simulation core for the Lab6 schedulers (fcfs.c, RoundRobin.c,
+// SJF_NONPreemptive.c, SJF_Preemptive.c): workload loading, the arrival sort,
+// the SJF ready heap and result printing.
+//
+// Everything here is static so each scheduler still builds on its own:
+//     cc -O2 -o fcfs fcfs.c
+//
+// A scheduler's main() parses its options with parseCommonOption, gets a
+// workload with loadWorkload (the built-in sample, a CSV file, a binary trace
+// or a generated one), sorts it with sortProcessesByArrival, runs its policy
+// over the Process array, which fills in completion_time, and prints the
+// results with printResults.
+//
+// Workload files:
+//   CSV           one process per line, "id,arrival,burst" or "arrival,burst"
+//                 (ids are then numbered from 1); commas or blanks separate the
+//                 fields, and a header line and '#' comments are skipped.
+//   binary trace  a TraceHeader followed by count TraceRecords, as written by
+//                 -o. Every field is little-endian whatever the host (see
+//                 encodeRecord/decodeRecord). The file is mmapped, not read,
+//                 so a trace can also be scanned in place (see traceRecords).
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Structure to represent a process. Times are 64-bit so that traces with
+// millions of processes cannot overflow them; waiting and turnaround time
+// follow from the completion time (see waitingTime and turnaroundTime).
+typedef struct {
+    int process_id;          // Process ID
+    int64_t arrival_time;    // Arrival time of the process
+    int64_t burst_time;      // Burst time (execution time) of the process
+    int64_t remaining_time;  // Burst time still to run, for the preemptive policies
+    int64_t completion_time; // Completion time of the process, set by the policy
+} Process;
+
+static inline int64_t turnaroundTime(const Process *p) {
+    return p->completion_time - p->arrival_time;
+}
+
+static inline int64_t waitingTime(const Process *p) {
+    return turnaroundTime(p) - p->burst_time;
+}
+
+#define TRACE_MAGIC "SCHEDTR1"
+
+typedef struct {
+    char magic[8];           // TRACE_MAGIC
+    uint64_t count;          // number of records that follow
+} TraceHeader;
+
+typedef struct {
+    int64_t arrival_time;
+    int32_t process_id;
+    int32_t burst_time;      // so a burst must fit in 32 bits to be saved
+} TraceRecord;
+
+static inline void encodeRecord(const Process *p, TraceRecord *record) {
+    record->arrival_time = (int64_t) htole64((uint64_t) p->arrival_time);
+    record->process_id = (int32_t) htole32((uint32_t) p->process_id);
+    record->burst_time = (int32_t) htole32((uint32_t) p->burst_time);
+}
+
+static inline void decodeRecord(const TraceRecord *record, Process *p) {
+    p->arrival_time = (int64_t) le64toh((uint64_t) record->arrival_time);
+    p->process_id = (int32_t) le32toh((uint32_t) record->process_id);
+    p->burst_time = (int32_t) le32toh((uint32_t) record->burst_time);
+}
+
+typedef struct {
+    Process *processes;
+    size_t count;
+} Workload;
+
+// Options every scheduler understands
+typedef struct {
+    const char *input;       // workload file, NULL for the built-in sample
+    const char *output;      // -o: write the workload as a binary trace
+    size_t generate;         // -g N: generate N processes instead
+    uint64_t seed;           // -s: seed for -g
+    int summary;             // -S: print only aggregate statistics
+} Options;
+
+static void printCommonUsage(const char *program, const char *extra) {
+    fprintf(stderr, "usage: %s %s[-g count] [-s seed] [-o trace.bin] [-S] [workload.csv | trace.bin]\n", program, extra);
+}
+
+// Parses the argument of a numeric option: digits only, at most max. Returns
+// 0 (with a message) if it is anything else, such as "abc", "-5" or "10x".
+static int parseCount(const char *option, const char *s, uint64_t max, uint64_t *value) {
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*s < '0' || *s > '9' || *end != '\0' || errno != 0 || v > max) {
+        fprintf(stderr, "%s: expected a whole number no larger than %llu, got \"%s\"\n", option, (unsigned long long) max, s);
+        return 0;
+    }
+    *value = v;
+    return 1;
+}
+
+// Handles argv[*i] if it is one of the common options (or the workload file),
+// advancing *i past its argument. Returns 0 if the argument is not recognised
+// or its value is not valid.
+static int parseCommonOption(Options *options, int argc, char *argv[], int *i) {
+    const char *arg = argv[*i];
+    uint64_t value;
+    if (strcmp(arg, "-g") == 0 && *i + 1 < argc) {
+        if (!parseCount(arg, argv[++*i], SIZE_MAX, &value)) return 0;
+        if (value == 0) {
+            fprintf(stderr, "-g: the count must be positive\n");
+            return 0;
+        }
+        options->generate = value;
+    }
+    else if (strcmp(arg, "-s") == 0 && *i + 1 < argc) {
+        if (!parseCount(arg, argv[++*i], UINT64_MAX, &options->seed)) return 0;
+    }
+    else if (strcmp(arg, "-o") == 0 && *i + 1 < argc) {
+        options->output = argv[++*i];
+    }
+    else if (strcmp(arg, "-S") == 0) {
+        options->summary = 1;
+    }
+    else if (arg[0] != '-' && options->input == NULL) {
+        options->input = arg;
+    }
+    else {
+        return 0;
+    }
+    return 1;
+}
+
+// Maps a whole file read-only. Returns NULL (with a message) on failure; an
+// empty file maps to a non-NULL pointer with *size 0.
+static void *mapFile(const char *path, size_t *size) {
+    static char empty;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    *size = st.st_size;
+    if (*size == 0) {
+        close(fd);
+        return &empty;
+    }
+    void *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+    madvise(data, *size, MADV_SEQUENTIAL);
+    return data;
+}
+
+static void unmapFile(void *data, size_t size) {
+    if (size > 0) munmap(data, size);
+}
+
+// The records of a mapped binary trace, or NULL if data is not one. *count is
+// set to the number of records.
+static const TraceRecord *traceRecords(const void *data, size_t size, size_t *count) {
+    const TraceHeader *header = data;
+    if (size < sizeof(TraceHeader) || memcmp(header->magic, TRACE_MAGIC, 8) != 0) return NULL;
+    uint64_t records = le64toh(header->count);
+    if (records > (size - sizeof(TraceHeader)) / sizeof(TraceRecord)) {
+        fprintf(stderr, "trace: header says %llu records but the file is shorter\n", (unsigned long long) records);
+        return NULL;
+    }
+    *count = records;
+    return (const TraceRecord *) (header + 1);
+}
+
+static Process *allocateProcesses(size_t count) {
+    Process *processes = malloc((count ? count : 1) * sizeof(Process));
+    if (processes == NULL) {
+        fprintf(stderr, "cannot allocate %zu processes\n", count);
+        exit(EXIT_FAILURE);
+    }
+    return processes;
+}
+
+// Parses one unsigned or negative decimal number at *p, skipping leading blanks
+// and commas. Returns 0 if there is no number before the end of the line, and
+// -1 if the number does not fit in an int64_t.
+static int parseField(const char **p, const char *end, int64_t *value) {
+    const char *s = *p;
+    while (s < end && (*s == ' ' || *s == '\t' || *s == ',' || *s == '\r')) s++;
+    int negative = s < end && *s == '-';
+    if (negative) s++;
+    if (s >= end || *s < '0' || *s > '9') return 0;
+    int64_t v = 0;
+    while (s < end && *s >= '0' && *s <= '9') {
+        int digit = *s++ - '0';
+        if (v > (INT64_MAX - digit) / 10) return -1;
+        v = v * 10 + digit;
+    }
+    *value = negative ? -v : v;
+    *p = s;
+    return 1;
+}
+
+static int loadCSV(const char *path, const char *data, size_t size, Workload *workload) {
+    const char *p = data, *end = data + size;
+    size_t capacity = size / 8 + 16, count = 0, lineNumber = 0;
+    Process *processes = allocateProcesses(capacity);
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL) eol = end;
+        lineNumber++;
+
+        const char *s = p;
+        int64_t fields[3];
+        int numOfFields = 0;
+        while (s < eol && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+        if (s < eol && *s != '#') {
+            int field = 0;
+            while (numOfFields < 3 && (field = parseField(&s, eol, &fields[numOfFields])) > 0) numOfFields++;
+            if (field < 0) {
+                fprintf(stderr, "%s:%zu: number out of range\n", path, lineNumber);
+                free(processes);
+                return -1;
+            }
+            while (s < eol && (*s == ' ' || *s == '\t' || *s == ',' || *s == '\r')) s++;
+            if (numOfFields < 2 || s != eol) {
+                // the first line may be a header
+                if (lineNumber > 1 || count > 0) {
+                    fprintf(stderr, "%s:%zu: expected id,arrival,burst or arrival,burst\n", path, lineNumber);
+                    free(processes);
+                    return -1;
+                }
+            }
+            else {
+                if (count == capacity) {
+                    capacity *= 2;
+                    processes = realloc(processes, capacity * sizeof(Process));
+                    if (processes == NULL) {
+                        fprintf(stderr, "cannot allocate %zu processes\n", capacity);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                if (numOfFields == 3 && (fields[0] < INT32_MIN || fields[0] > INT32_MAX)) {
+                    fprintf(stderr, "%s:%zu: process id %lld is out of range\n", path, lineNumber, (long long) fields[0]);
+                    free(processes);
+                    return -1;
+                }
+                Process *proc = &processes[count++];
+                proc->process_id = numOfFields == 3 ? (int) fields[0] : (int) count;
+                proc->arrival_time = fields[numOfFields - 2];
+                proc->burst_time = fields[numOfFields - 1];
+            }
+        }
+        p = eol + 1;
+    }
+    workload->processes = processes;
+    workload->count = count;
+    return 0;
+}
+
+// Generator state for -g: the random state and the last arrival time
+typedef struct {
+    uint64_t state;
+    int64_t time;
+    size_t count;
+} Generator;
+
+static void initGenerator(Generator *generator, uint64_t seed) {
+    generator->state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    generator->time = 0;
+    generator->count = 0;
+}
+
+// The next generated process: uniform arrival gaps in [0, 20] and bursts in
+// [1, 17], about 90% load
+static void generateProcess(Generator *generator, Process *p) {
+    // xorshift64*
+    generator->state ^= generator->state >> 12;
+    generator->state ^= generator->state << 25;
+    generator->state ^= generator->state >> 27;
+    uint64_t r = generator->state * 0x2545F4914F6CDD1DULL;
+    generator->time += (r >> 32) % 21;
+    p->process_id = (int) ++generator->count;
+    p->arrival_time = generator->time;
+    p->burst_time = 1 + (int64_t) ((r & 0xFFFFFFFF) % 17);
+}
+
+static void generateWorkload(size_t count, uint64_t seed, Workload *workload) {
+    Generator generator;
+    initGenerator(&generator, seed);
+    workload->processes = allocateProcesses(count);
+    workload->count = count;
+    for (size_t i = 0; i < count; i++) {
+        generateProcess(&generator, &workload->processes[i]);
+    }
+}
+
+// Refuses, before creating the file, a workload with a burst the 32-bit
+// record field cannot hold, rather than saving a truncated trace.
+static int writeTrace(const char *path, const Workload *workload) {
+    for (size_t i = 0; i < workload->count; i++) {
+        const Process *p = &workload->processes[i];
+        if (p->burst_time > INT32_MAX) {
+            fprintf(stderr, "%s: process %d: burst time %lld does not fit in a trace record\n",
+                path, p->process_id, (long long) p->burst_time);
+            return -1;
+        }
+    }
+
+    FILE *out = fopen(path, "wb");
+    TraceHeader header = { TRACE_MAGIC, htole64(workload->count) };
+    if (out == NULL) {
+        perror(path);
+        return -1;
+    }
+    fwrite(&header, sizeof(header), 1, out);
+    for (size_t i = 0; i < workload->count; i++) {
+        TraceRecord record;
+        encodeRecord(&workload->processes[i], &record);
+        fwrite(&record, sizeof(record), 1, out);
+    }
+    if (fclose(out) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Fills workload from the options: -g, then the input file (a binary trace
+// if it starts with the trace magic, CSV otherwise), then the sample. Writes
+// the -o trace if asked. remaining_time starts out as the burst time.
+static int loadWorkload(const Options *options, const Process *sample, size_t sampleCount, Workload *workload) {
+    if (options->generate > 0) {
+        generateWorkload(options->generate, options->seed, workload);
+    }
+    else if (options->input != NULL) {
+        size_t size, count;
+        void *data = mapFile(options->input, &size);
+        if (data == NULL) return -1;
+        const TraceRecord *records = traceRecords(data, size, &count);
+        int status = 0;
+        if (records != NULL) {
+            workload->processes = allocateProcesses(count);
+            workload->count = count;
+            for (size_t i = 0; i < count; i++) {
+                decodeRecord(&records[i], &workload->processes[i]);
+            }
+        }
+        else {
+            status = loadCSV(options->input, data, size, workload);
+        }
+        unmapFile(data, size);
+        if (status != 0) return status;
+    }
+    else {
+        workload->processes = allocateProcesses(sampleCount);
+        workload->count = sampleCount;
+        memcpy(workload->processes, sample, sampleCount * sizeof(Process));
+    }
+
+    for (size_t i = 0; i < workload->count; i++) {
+        Process *p = &workload->processes[i];
+        if (p->burst_time <= 0 || p->arrival_time < 0) {
+            fprintf(stderr, "process %d: arrival time must be >= 0 and burst time > 0\n", p->process_id);
+            free(workload->processes);
+            return -1;
+        }
+        p->remaining_time = p->burst_time;
+        p->completion_time = 0;
+    }
+    if (options->output != NULL && writeTrace(options->output, workload) != 0) {
+        free(workload->processes);
+        return -1;
+    }
+    return 0;
+}
+
+static void freeWorkload(Workload *workload) {
+    free(workload->processes);
+    workload->processes = NULL;
+    workload->count = 0;
+}
+
+// Stable merge sort of the processes by arrival time, O(n log n). Processes
+// that arrive together keep their input order, as with the bubble sort this
+// replaces. Input that is already in order (the usual case for a trace) is
+// detected in one pass and left alone.
+static void sortProcessesByArrival(Process processes[], size_t n) {
+    size_t i = 1;
+    while (i < n && processes[i - 1].arrival_time <= processes[i].arrival_time) i++;
+    if (i >= n) return;
+
+    Process *buffer = allocateProcesses(n);
+    Process *from = processes, *to = buffer;
+    for (size_t width = 1; width < n; width *= 2) {
+        for (size_t left = 0; left < n; left += 2 * width) {
+            size_t mid = left + width < n ? left + width : n;
+            size_t right = left + 2 * width < n ? left + 2 * width : n;
+            size_t a = left, b = mid, k = left;
+            while (a < mid && b < right) {
+                to[k++] = from[b].arrival_time < from[a].arrival_time ? from[b++] : from[a++];
+            }
+            while (a < mid) to[k++] = from[a++];
+            while (b < right) to[k++] = from[b++];
+        }
+        Process *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != processes) memcpy(processes, from, n * sizeof(Process));
+    free(buffer);
+}
+
+// Min-heap ready queue for the SJF policies. Entries are ordered by key (the
+// burst or remaining time) and then by index into the sorted process array,
+// which is the order the old linear scans picked ties in. The key is kept in
+// the entry so sifting does not touch the process array.
+typedef struct {
+    int64_t key;
+    size_t index;
+} HeapEntry;
+
+typedef struct {
+    HeapEntry *entries;
+    size_t size;
+} ReadyHeap;
+
+static inline int heapLess(const HeapEntry *a, const HeapEntry *b) {
+    return a->key < b->key || (a->key == b->key && a->index < b->index);
+}
+
+// A heap that can hold every process, so pushes never reallocate
+static inline void heapInit(ReadyHeap *heap, size_t capacity) {
+    heap->entries = malloc((capacity ? capacity : 1) * sizeof(HeapEntry));
+    heap->size = 0;
+    if (heap->entries == NULL) {
+        fprintf(stderr, "cannot allocate a ready queue of %zu processes\n", capacity);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static inline void heapPush(ReadyHeap *heap, int64_t key, size_t index) {
+    HeapEntry entry = { key, index };
+    size_t i = heap->size++;
+    while (i > 0 && heapLess(&entry, &heap->entries[(i - 1) / 2])) {
+        heap->entries[i] = heap->entries[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->entries[i] = entry;
+}
+
+// Removes the smallest entry; the caller reads it from entries[0] first
+static inline void heapPop(ReadyHeap *heap) {
+    HeapEntry last = heap->entries[--heap->size];
+    size_t i = 0, n = heap->size;
+    while (2 * i + 1 < n) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < n && heapLess(&heap->entries[child + 1], &heap->entries[child])) child++;
+        if (!heapLess(&heap->entries[child], &last)) break;
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    if (n > 0) heap->entries[i] = last;
+}
+
+static inline void heapFree(ReadyHeap *heap) {
+    free(heap->entries);
+    heap->entries = NULL;
+    heap->size = 0;
+}
+
+// Prints one row per process, as the schedulers always have, or with -S only
+// the aggregate statistics, which is what makes sense for large traces.
+static void printResults(const Options *options, const Process processes[], size_t n) {
+    if (!options->summary) {
+        printf("ProcessID\tArrival Time\tBurst Time\tWaiting Time\tTurnaround Time\tCompletion Time\n");
+        for (size_t i = 0; i < n; i++) {
+            printf("%d\t\t%lld\t\t%lld\t\t%lld\t\t%lld\t\t%lld\n",
+                processes[i].process_id,
+                (long long) processes[i].arrival_time,
+                (long long) processes[i].burst_time,
+                (long long) waitingTime(&processes[i]),
+                (long long) turnaroundTime(&processes[i]),
+                (long long) processes[i].completion_time);
+        }
+        return;
+    }
+
+    double totalWaiting = 0, totalTurnaround = 0;
+    int64_t makespan = 0, busy = 0;
+    for (size_t i = 0; i < n; i++) {
+        totalWaiting += waitingTime(&processes[i]);
+        totalTurnaround += turnaroundTime(&processes[i]);
+        busy += processes[i].burst_time;
+        if (processes[i].completion_time > makespan) makespan = processes[i].completion_time;
+    }
+    printf("processes            %zu\n", n);
+    printf("average waiting      %.3f\n", n ? totalWaiting / n : 0.0);
+    printf("average turnaround   %.3f\n", n ? totalTurnaround / n : 0.0);
+    printf("last completion      %lld\n", (long long) makespan);
+    printf("cpu utilization      %.2f%%\n", makespan ? 100.0 * busy / makespan : 0.0);
+}
+
+#endif